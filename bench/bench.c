@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "timing.h"
+
+/*
+ * Benchmark harness for mishell. Every benchmark runs the real shell code
+ * (parse_command, process_command and the builtins) on generated input in
+ * a scratch directory and prints one JSON object per result line:
+ *
+ *   {"version":"...","bench":"parse","metric":"lines","value":...,
+ *    "unit":"lines/s","iterations":...,"seconds":...}
+ *
+ * Usage: mishell-bench [-t min_seconds] [-v version] [bench ...]
+ * With no bench names every benchmark runs.
+ */
+
+#define PARSE_LINES 10000
+#define PIPE_FILE_SIZE (64 * 1024 * 1024)
+#define CLOC_DIRS 20
+#define CLOC_FILES_PER_DIR 50
+#define CLOC_LINES_PER_FILE 200
+#define SEARCH_FILE_SIZE (32 * 1024 * 1024)
+
+static double min_seconds = 1.0;
+static const char *version = "unknown";
+static int null_fd = -1;
+static int saved_stdout = -1;
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ULL;
+
+static unsigned int rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (unsigned int)(rng_state >> 32);
+}
+
+static double now_s(void) {
+	return timing_now_ns() / 1e9;
+}
+
+static void report(const char *bench, const char *metric, double value,
+				   const char *unit, long iterations, double seconds) {
+	printf("{\"version\":\"%s\",\"bench\":\"%s\",\"metric\":\"%s\","
+		   "\"value\":%.3f,\"unit\":\"%s\",\"iterations\":%ld,"
+		   "\"seconds\":%.6f}\n",
+		   version, bench, metric, value, unit, iterations, seconds);
+	fflush(stdout);
+}
+
+// builtins print their results, keep them out of the report
+static void silence_stdout(void) {
+	fflush(stdout);
+	saved_stdout = dup(STDOUT_FILENO);
+	dup2(null_fd, STDOUT_FILENO);
+}
+
+static void restore_stdout(void) {
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+}
+
+/**
+ * Parse and run one command line the way the prompt loop does
+ */
+static int run_line(const char *line) {
+	char buf[4096];
+	struct command_t *command = calloc(1, sizeof(struct command_t));
+	snprintf(buf, sizeof(buf), "%s", line);
+	parse_command(buf, command);
+	int code = process_command(command);
+	free_command(command);
+	return code;
+}
+
+static int write_file(const char *path, const char *data, size_t len) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return -1;
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n == -1) {
+			close(fd);
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return close(fd);
+}
+
+static const char *words[] = {
+	"ls", "-la", "grep", "foo", "cat", "file.txt", "sort", "-n", "uniq",
+	"wc", "-l", "echo", "\"quoted arg\"", "src/main.c", "head", "-20",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static void bench_parse(void) {
+	char **lines = malloc(sizeof(char *) * PARSE_LINES);
+	size_t total_bytes = 0;
+	for (int i = 0; i < PARSE_LINES; i++) {
+		char line[512];
+		size_t len = 0;
+		int stages = 1 + rng() % 4;
+		for (int s = 0; s < stages; s++) {
+			int argc = 1 + rng() % 6;
+			for (int a = 0; a < argc; a++) {
+				len += snprintf(line + len, sizeof(line) - len, "%s ",
+								words[rng() % WORD_COUNT]);
+			}
+			if (s + 1 < stages)
+				len += snprintf(line + len, sizeof(line) - len, "| ");
+		}
+		if (rng() % 4 == 0)
+			len += snprintf(line + len, sizeof(line) - len, ">out.txt");
+		lines[i] = strdup(line);
+		total_bytes += len;
+	}
+
+	long iterations = 0;
+	double start = now_s(), elapsed;
+	do {
+		for (int i = 0; i < PARSE_LINES; i++) {
+			char buf[512];
+			struct command_t *command = calloc(1, sizeof(struct command_t));
+			strcpy(buf, lines[i]);
+			parse_command(buf, command);
+			free_command(command);
+		}
+		iterations++;
+		elapsed = now_s() - start;
+	} while (elapsed < min_seconds);
+
+	report("parse", "lines", iterations * PARSE_LINES / elapsed, "lines/s",
+		   iterations * PARSE_LINES, elapsed);
+	report("parse", "bytes", iterations * total_bytes / elapsed / 1e6, "MB/s",
+		   iterations * PARSE_LINES, elapsed);
+
+	for (int i = 0; i < PARSE_LINES; i++)
+		free(lines[i]);
+	free(lines);
+}
+
+static void bench_launch(void) {
+	long iterations = 0;
+	double start = now_s(), elapsed;
+	do {
+		run_line("true");
+		iterations++;
+		elapsed = now_s() - start;
+	} while (elapsed < min_seconds);
+	report("launch", "true", iterations / elapsed, "launches/s", iterations,
+		   elapsed);
+}
+
+static void bench_pipeline(void) {
+	char *data = malloc(PIPE_FILE_SIZE);
+	for (size_t i = 0; i < PIPE_FILE_SIZE; i++)
+		data[i] = 'a' + i % 26;
+	if (write_file("pipe.dat", data, PIPE_FILE_SIZE) == -1) {
+		perror("pipe.dat");
+		free(data);
+		return;
+	}
+	free(data);
+
+	int stage_counts[] = { 1, 2, 4, 8 };
+	for (size_t c = 0; c < sizeof(stage_counts) / sizeof(int); c++) {
+		// /bin/cat by path: the cat builtin would run the stages as
+		// threads, and the numbers would not compare with earlier runs
+		char line[512];
+		size_t len = snprintf(line, sizeof(line), "/bin/cat pipe.dat");
+		for (int s = 1; s < stage_counts[c]; s++)
+			len += snprintf(line + len, sizeof(line) - len, " | /bin/cat");
+		snprintf(line + len, sizeof(line) - len, " >/dev/null");
+
+		long iterations = 0;
+		double start = now_s(), elapsed;
+		do {
+			run_line(line);
+			iterations++;
+			elapsed = now_s() - start;
+		} while (elapsed < min_seconds);
+
+		char metric[32];
+		snprintf(metric, sizeof(metric), "cat_x%d", stage_counts[c]);
+		report("pipeline", metric,
+			   (double)PIPE_FILE_SIZE * iterations / elapsed / 1e6, "MB/s",
+			   iterations, elapsed);
+	}
+	unlink("pipe.dat");
+}
+
+static const char *c_lines[] = {
+	"int main(void) {\n", "\n", "// a comment\n", "/* block */\n",
+	"\treturn 0;\n", "}\n",
+};
+static const char *py_lines[] = {
+	"def f(x):\n", "\n", "# comment\n", "    return x\n", "'''doc'''\n",
+};
+
+static void bench_cloc(void) {
+	long total_lines = 0;
+	mkdir("tree", 0755);
+	for (int d = 0; d < CLOC_DIRS; d++) {
+		char dir[64];
+		snprintf(dir, sizeof(dir), "tree/d%02d", d);
+		mkdir(dir, 0755);
+		for (int f = 0; f < CLOC_FILES_PER_DIR; f++) {
+			static const char *exts[] = { ".c", ".py", ".cpp", ".txt" };
+			const char *ext = exts[f % 4];
+			bool py = strcmp(ext, ".py") == 0;
+			char path[128], content[CLOC_LINES_PER_FILE * 32];
+			size_t len = 0;
+			snprintf(path, sizeof(path), "%s/f%03d%s", dir, f, ext);
+			for (int l = 0; l < CLOC_LINES_PER_FILE; l++) {
+				const char *line = py ? py_lines[rng() % 5] :
+										c_lines[rng() % 6];
+				len += snprintf(content + len, sizeof(content) - len, "%s",
+								line);
+			}
+			write_file(path, content, len);
+			total_lines += CLOC_LINES_PER_FILE;
+		}
+	}
+
+	long iterations = 0;
+	double start = now_s(), elapsed;
+	silence_stdout();
+	do {
+		run_line("cloc tree");
+		iterations++;
+		elapsed = now_s() - start;
+	} while (elapsed < min_seconds);
+	restore_stdout();
+
+	long files = CLOC_DIRS * CLOC_FILES_PER_DIR;
+	report("cloc", "files", files * iterations / elapsed, "files/s",
+		   iterations, elapsed);
+	report("cloc", "lines", total_lines * iterations / elapsed, "lines/s",
+		   iterations, elapsed);
+}
+
+static void bench_searchwords(void) {
+	char *data = malloc(SEARCH_FILE_SIZE);
+	size_t len = 0;
+	while (len < SEARCH_FILE_SIZE - 32) {
+		const char *w = (rng() % 100 == 0) ? "needle" : words[rng() % 11];
+		len += snprintf(data + len, SEARCH_FILE_SIZE - len, "%s%c", w,
+						rng() % 10 ? ' ' : '\n');
+	}
+	if (write_file("words.txt", data, len) == -1) {
+		perror("words.txt");
+		free(data);
+		return;
+	}
+	free(data);
+
+	long iterations = 0;
+	double start = now_s(), elapsed;
+	silence_stdout();
+	do {
+		run_line("searchwords words.txt needle");
+		iterations++;
+		elapsed = now_s() - start;
+	} while (elapsed < min_seconds);
+	restore_stdout();
+
+	report("searchwords", "bytes", (double)len * iterations / elapsed / 1e6,
+		   "MB/s", iterations, elapsed);
+	unlink("words.txt");
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+						struct FTW *ftw) {
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+struct bench {
+	const char *name;
+	void (*run)(void);
+};
+
+static const struct bench benches[] = {
+	{ "parse", bench_parse },	  { "launch", bench_launch },
+	{ "pipeline", bench_pipeline }, { "cloc", bench_cloc },
+	{ "searchwords", bench_searchwords },
+};
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "t:v:")) != -1) {
+		if (opt == 't') {
+			min_seconds = atof(optarg);
+		} else if (opt == 'v') {
+			version = optarg;
+		} else {
+			fprintf(stderr,
+					"Usage: %s [-t min_seconds] [-v version] [bench ...]\n",
+					argv[0]);
+			return 2;
+		}
+	}
+
+	char scratch[] = "/tmp/mishell-bench-XXXXXX";
+	if (mkdtemp(scratch) == NULL || chdir(scratch) == -1) {
+		perror("mishell-bench: scratch directory");
+		return 1;
+	}
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	for (size_t b = 0; b < BENCH_COUNT; b++) {
+		bool selected = optind == argc;
+		for (int i = optind; i < argc; i++)
+			selected |= strcmp(argv[i], benches[b].name) == 0;
+		if (selected)
+			benches[b].run();
+	}
+
+	if (chdir("/") == 0)
+		nftw(scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	return 0;
+}
@@ -1,10 +1,17 @@
+#include <linux/cgroup.h>
+#include <linux/bsearch.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/pid.h>
+#include <linux/pid_namespace.h>
 #include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 
 // Meta Information
 MODULE_LICENSE("GPL");
@@ -32,38 +39,302 @@ int pid;
 module_param(pid, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(pid, "Id of the process");
 
-void pstree(struct task_struct *task, int pid, int eldest) {
-	struct task_struct *ts;
-	struct list_head *task_list;
-	bool is_eldest = true;
-	if (pid != 0) {
-		//printk("%s,%d,%lld,%d,%lld,%d\n", task->comm, task->parent->pid,task->parent->start_time,task->pid,task->start_time,eldest);
+/*
+ * Query options, applied while walking so that only the requested slice of
+ * a big process tree reaches the log
+ */
+bool threads;
+module_param(threads, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(threads, "Also show the threads of every process");
+
+int pidns;
+module_param(pidns, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(pidns,
+				 "Only show processes in the PID namespace of this process");
+
+char *cgroup;
+module_param(cgroup, charp, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(cgroup,
+				 "Only show processes in this cgroup v2 path or below it");
+
+int max_depth;
+module_param(max_depth, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(max_depth, "Levels below the root to show, 0 for all");
+
+int min_size;
+module_param(min_size, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(min_size, "Leave out subtrees with fewer processes");
+
+static struct pid_namespace *filter_ns;
+static struct cgroup *filter_cgroup;
+
+#define PROCS_SLACK 256 // room for processes forked while counting
+
+/*
+ * A process as it was when the tree was taken, linked to its parent and
+ * children by index into the sorted snapshot
+ */
+struct proc {
+	pid_t pid, ppid;
+	u64 start_time;
+	bool shown;
+	bool child_printed;
+	int parent, first_child, next_sibling; // -1 for none
+	int depth; // levels below the root, -1 until the walk gets there
+	int size; // shown processes in the walked subtree
+};
+
+// whether a task passes the namespace and cgroup filters, under RCU
+static bool shown(struct task_struct *task) {
+	if (filter_ns != NULL && task_pid_nr_ns(task, filter_ns) == 0)
+		return false;
+	if (filter_cgroup != NULL &&
+		!cgroup_is_descendant(task_dfl_cgroup(task), filter_cgroup))
+		return false;
+	return true;
+}
+
+static void print_edge(const struct proc *parent, const struct proc *proc,
+					   bool eldest) {
+	if (parent->shown)
 		printk(
 			"\"PID:%d, Creation Time:%lld\" ->\"PID:%d, Creation Time:%lld\"\n",
-			task->parent->pid, task->parent->start_time, task->pid,
-			task->start_time);
-		if (eldest) {
-			printk("\"PID:%d, Creation Time:%lld\"[color=blue]\n", task->pid,
-				   task->start_time);
+			parent->pid, parent->start_time, proc->pid, proc->start_time);
+	else // the parent is filtered out, the process stands alone
+		printk("\"PID:%d, Creation Time:%lld\"\n", proc->pid,
+			   proc->start_time);
+	if (eldest) {
+		printk("\"PID:%d, Creation Time:%lld\"[color=blue]\n", proc->pid,
+			   proc->start_time);
+	}
+}
+
+/*
+ * Threads are looked up again by pid rather than copied into the snapshot.
+ * The thread list is RCU protected; a process that exited since, or whose
+ * pid was reused, has none to show.
+ */
+static void print_threads(const struct proc *proc) {
+	struct task_struct *task, *t;
+	rcu_read_lock();
+	task = pid_task(find_pid_ns(proc->pid, &init_pid_ns), PIDTYPE_PID);
+	if (task != NULL && task->start_time == proc->start_time) {
+		for_each_thread(task, t) {
+			if (t == task)
+				continue;
+			printk(
+				"\"PID:%d, Creation Time:%lld\" ->\"TID:%d, Creation Time:%lld\"[style=dashed]\n",
+				proc->pid, proc->start_time, t->pid, t->start_time);
 		}
 	}
-	list_for_each(task_list, &task->children) {
-		ts = list_entry(task_list, struct task_struct, sibling);
-		if (is_eldest) {
-			pstree(ts, task->pid, 1);
-			is_eldest = false;
-		} else {
-			pstree(ts, task->pid, 0);
+	rcu_read_unlock();
+}
+
+static int proc_cmp(const void *a, const void *b) {
+	const struct proc *x = a, *y = b;
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+static int pid_cmp(const void *key, const void *elt) {
+	pid_t pid = *(const pid_t *)key;
+	const struct proc *proc = elt;
+	return pid < proc->pid ? -1 : pid > proc->pid;
+}
+
+static int find_proc(struct proc *procs, int count, pid_t pid) {
+	struct proc *proc =
+		bsearch(&pid, procs, count, sizeof(*procs), pid_cmp);
+	return proc == NULL ? -1 : proc - procs;
+}
+
+/**
+ * Copy every process with its parent, sorted by pid. The children and
+ * sibling lists need tasklist_lock, which modules can't take, so the tree
+ * is rebuilt from real_parent: the process list and real_parent are RCU
+ * protected. Children forked by any thread of a process get the process
+ * as their parent.
+ * @param  procs set to the snapshot, to be freed with kvfree
+ * @return       number of processes, or -ENOMEM
+ */
+static int take_snapshot(struct proc **procs) {
+	struct task_struct *p;
+	int capacity, count, i;
+
+	for (;;) {
+		capacity = PROCS_SLACK;
+		rcu_read_lock();
+		for_each_process(p)
+			capacity++;
+		rcu_read_unlock();
+
+		*procs = kvmalloc_array(capacity, sizeof(**procs), GFP_KERNEL);
+		if (*procs == NULL)
+			return -ENOMEM;
+		count = 0;
+		rcu_read_lock();
+		for_each_process(p) {
+			struct proc *proc = &(*procs)[count];
+			if (count == capacity)
+				break;
+			proc->pid = task_tgid_nr(p);
+			proc->ppid = task_tgid_nr(rcu_dereference(p->real_parent));
+			proc->start_time = p->start_time;
+			proc->shown = shown(p);
+			count++;
 		}
+		rcu_read_unlock();
+		if (count < capacity)
+			break;
+		kvfree(*procs); // more forks than the slack, count again
 	}
+
+	sort(*procs, count, sizeof(**procs), proc_cmp, NULL);
+	for (i = 0; i < count; i++) {
+		(*procs)[i].child_printed = false;
+		(*procs)[i].first_child = (*procs)[i].next_sibling = -1;
+		(*procs)[i].depth = -1;
+		(*procs)[i].size = 0;
+	}
+	// backwards, so that children end up in pid order
+	for (i = count - 1; i >= 0; i--) {
+		struct proc *proc = &(*procs)[i];
+		proc->parent = find_proc(*procs, count, proc->ppid);
+		if (proc->parent == i)
+			proc->parent = -1;
+		if (proc->parent != -1) {
+			proc->next_sibling = (*procs)[proc->parent].first_child;
+			(*procs)[proc->parent].first_child = i;
+		}
+	}
+	return count;
+}
+
+/**
+ * Print the processes below root. The walk uses a stack of its own instead
+ * of recursion, so a deep tree can't overflow the kernel stack, and visits
+ * every process at most once, so even a snapshot torn by reparenting can't
+ * make it loop.
+ * @return 0, or -ENOMEM
+ */
+static int pstree(struct proc *procs, int count, int root) {
+	int *stack, *order;
+	int top = 0, walked = 0, i, k;
+
+	stack = kvmalloc_array(count, sizeof(int), GFP_KERNEL);
+	order = kvmalloc_array(count, sizeof(int), GFP_KERNEL);
+	if (stack == NULL || order == NULL) {
+		kvfree(stack);
+		kvfree(order);
+		return -ENOMEM;
+	}
+
+	// parents before children, siblings in pid order
+	procs[root].depth = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		int first;
+		i = stack[--top];
+		order[walked++] = i;
+		if (max_depth != 0 && procs[i].depth >= max_depth)
+			continue;
+		first = top;
+		for (k = procs[i].first_child; k != -1; k = procs[k].next_sibling) {
+			if (procs[k].depth != -1)
+				continue;
+			procs[k].depth = procs[i].depth + 1;
+			stack[top++] = k;
+		}
+		// the first child has to be popped first
+		for (k = 0; k < (top - first) / 2; k++)
+			swap(stack[first + k], stack[top - 1 - k]);
+	}
+
+	// subtree sizes, children before their parent
+	for (k = walked - 1; k >= 0; k--) {
+		i = order[k];
+		if (procs[i].shown)
+			procs[i].size++;
+		if (i != root)
+			procs[procs[i].parent].size += procs[i].size;
+	}
+
+	for (k = 0; k < walked; k++) {
+		struct proc *proc = &procs[order[k]];
+		if (!proc->shown || proc->size < min_size)
+			continue;
+		if (order[k] != root) {
+			struct proc *parent = &procs[proc->parent];
+			print_edge(parent, proc, !parent->child_printed);
+			parent->child_printed = true;
+		}
+		if (threads)
+			print_threads(proc);
+	}
+
+	kvfree(stack);
+	kvfree(order);
+	return 0;
+}
+
+static int filters_init(void) {
+	if (pidns != 0) {
+		struct task_struct *ns_task;
+		rcu_read_lock();
+		ns_task = get_pid_task(find_vpid(pidns), PIDTYPE_PID);
+		rcu_read_unlock();
+		if (ns_task == NULL)
+			return -ESRCH;
+		filter_ns = get_pid_ns(task_active_pid_ns(ns_task));
+		put_task_struct(ns_task);
+	}
+	if (cgroup != NULL && cgroup[0]) {
+		filter_cgroup = cgroup_get_from_path(cgroup);
+		if (IS_ERR(filter_cgroup)) {
+			int err = PTR_ERR(filter_cgroup);
+			filter_cgroup = NULL;
+			return err;
+		}
+	}
+	return 0;
+}
+
+static void filters_exit(void) {
+	if (filter_ns != NULL)
+		put_pid_ns(filter_ns);
+	if (filter_cgroup != NULL)
+		cgroup_put(filter_cgroup);
+	filter_ns = NULL;
+	filter_cgroup = NULL;
 }
 
 // A function that runs when the module is first loaded
 int simple_init(void) {
 	struct task_struct *ts;
-	ts = get_pid_task(find_get_pid(pid), PIDTYPE_PID);
-	pstree(ts, 0, 0);
-	return 0;
+	struct proc *procs;
+	pid_t root_pid = 0;
+	int count, root;
+	int err = filters_init();
+	if (err != 0) {
+		filters_exit();
+		return err;
+	}
+
+	rcu_read_lock();
+	ts = pid_task(find_vpid(pid), PIDTYPE_PID);
+	if (ts != NULL)
+		root_pid = task_tgid_nr(ts);
+	rcu_read_unlock();
+
+	count = root_pid == 0 ? -ESRCH : take_snapshot(&procs);
+	if (count < 0) {
+		filters_exit();
+		return count;
+	}
+	root = find_proc(procs, count, root_pid);
+	err = root == -1 ? -ESRCH : pstree(procs, count, root);
+	kvfree(procs);
+	filters_exit();
+	return err;
 }
 
 // A function that runs when the module is removed
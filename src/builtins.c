@@ -0,0 +1,1238 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "copy.h"
+#include "move.h"
+#include "parallel.h"
+#include "prompt.h"
+#include "roll.h"
+#include "shell.h"
+#include "timing.h"
+#include "trace.h"
+#include "watch.h"
+
+static void removeSpaces(char *str) {
+	int count = 0;
+	for (int i = 0; str[i]; i++)
+		if (str[i] != ' ' && str[i] != '\t')
+			str[count++] = str[i]; // here count is incremented
+	str[count] = '\0';
+}
+static void lineCount(int counts[4][4], char *fileName) {
+	FILE *fp = fopen(fileName, "r");
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t read;
+	char *ext = strrchr(fileName, '.');
+
+	// Check if file exists
+	if (fp == NULL) {
+		fprintf(stderr, "Could not open file %s\n", fileName);
+		return;
+	}
+	bool command = false;
+	while ((read = getline(&line, &len, fp)) != -1) {
+		removeSpaces(line);
+		if (ext) {
+			if (strcmp(ext, ".py") == 0) { //PYTHON.
+				if (strlen(line) == 1) {
+					counts[0][1] += 1;
+				} else if (line[0] == '\'' && line[1] == '\'' &&
+						   line[2] == '\'') {
+					command = true;
+					counts[0][2] += 1;
+					if (strstr(line, "\'\'\'") != NULL) {
+						command = false;
+					}
+				} else if (command) {
+					counts[0][2] += 1;
+					if (strstr(line, "\'\'\'") != NULL) {
+						command = false;
+					}
+				} else if (line[0] == '\"' && line[1] == '\"' &&
+						   line[2] == '\"') {
+					command = true;
+					counts[0][2] += 1;
+					if (strstr(line, "\"\"\"") != NULL) {
+						command = false;
+					}
+				} else if (command) {
+					counts[0][2] += 1;
+					if (strstr(line, "\"\"\"") != NULL) {
+						command = false;
+					}
+				} else if (line[0] == '#') {
+					counts[0][2] += 1;
+				} else {
+					counts[0][0] += 1;
+				}
+
+			} else if (strcmp(ext, ".cpp") == 0) { //C++.
+				if (strlen(line) == 1) {
+					counts[1][1] += 1;
+				} else if (line[0] == '/' && line[1] == '*') {
+					command = true;
+					counts[1][2] += 1;
+					if (strstr(line, "*/") != NULL) {
+						command = false;
+					}
+				} else if (command) {
+					counts[1][2] += 1;
+					if (strstr(line, "*/") != NULL) {
+						command = false;
+					}
+				} else if (line[0] == '/' && line[1] == '/') {
+					counts[1][2] += 1;
+				} else {
+					counts[1][0] += 1;
+				}
+
+			} else if (strcmp(ext, ".c") == 0) { //C.
+				if (strlen(line) == 1) {
+					counts[2][1] += 1;
+				} else if (line[0] == '/' && line[1] == '*') {
+					command = true;
+					counts[2][2] += 1;
+					if (strstr(line, "*/") != NULL) {
+						command = false;
+					}
+				} else if (command) {
+					counts[2][2] += 1;
+					if (strstr(line, "*/") != NULL) {
+						command = false;
+					}
+				} else if (line[0] == '/' && line[1] == '/') {
+					counts[2][2] += 1;
+				} else {
+					counts[2][0] += 1;
+				}
+			} else {
+				if (strlen(line) == 1) {
+					counts[3][1] += 1;
+				} else {
+					counts[3][0] += 1;
+				}
+			}
+		} else {
+			if (strlen(line) == 1) {
+				counts[3][1] += 1;
+			} else {
+				counts[3][0] += 1;
+			}
+		}
+	}
+
+	// Close the file
+	free(line);
+	fclose(fp);
+	return;
+}
+/*
+ * Line counts of single files for cloc, used again while a file's inode,
+ * size and times stay the same. It is only on inside watch-run, whose
+ * command counts the same mostly unchanged tree over and over; a plain
+ * cloc reads everything it counts.
+ */
+struct cloc_entry {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime, ctime;
+	int counts[4][3]; // what lineCount added for the file
+	struct cloc_entry *next; // hash chain
+};
+
+#define CLOC_CACHE_BUCKETS 8192
+#define CLOC_CACHE_MAX (1 << 17) // dropped whole beyond this many files
+
+static bool cloc_cache_enabled;
+static struct cloc_entry *cloc_cache[CLOC_CACHE_BUCKETS];
+static int cloc_cache_count;
+static pthread_mutex_t cloc_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash_name(const char *name, unsigned int seed);
+
+static bool cloc_entry_fresh(const struct cloc_entry *e,
+							 const struct stat *st) {
+	return e->dev == st->st_dev && e->ino == st->st_ino &&
+		   e->size == st->st_size &&
+		   e->mtime.tv_sec == st->st_mtim.tv_sec &&
+		   e->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+		   e->ctime.tv_sec == st->st_ctim.tv_sec &&
+		   e->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static void cloc_cache_clear(void) {
+	for (int i = 0; i < CLOC_CACHE_BUCKETS; i++) {
+		struct cloc_entry *next;
+		for (struct cloc_entry *e = cloc_cache[i]; e; e = next) {
+			next = e->next;
+			free(e->path);
+			free(e);
+		}
+		cloc_cache[i] = NULL;
+	}
+	cloc_cache_count = 0;
+}
+
+/**
+ * lineCount through the cache: only a file that changed since it was last
+ * counted is read again
+ */
+static void cachedLineCount(int counts[4][4], char *fileName) {
+	struct stat st;
+	if (!cloc_cache_enabled || stat(fileName, &st) == -1 ||
+		!S_ISREG(st.st_mode)) {
+		lineCount(counts, fileName);
+		return;
+	}
+
+	unsigned int slot = hash_name(fileName, 0) % CLOC_CACHE_BUCKETS;
+	pthread_mutex_lock(&cloc_cache_lock);
+	struct cloc_entry *e = cloc_cache[slot];
+	while (e != NULL && strcmp(e->path, fileName) != 0)
+		e = e->next;
+	if (e != NULL && cloc_entry_fresh(e, &st)) {
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 3; j++)
+				counts[i][j] += e->counts[i][j];
+		pthread_mutex_unlock(&cloc_cache_lock);
+		return;
+	}
+	pthread_mutex_unlock(&cloc_cache_lock);
+
+	int file_counts[4][4] = { { 0 } };
+	lineCount(file_counts, fileName);
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 3; j++)
+			counts[i][j] += file_counts[i][j];
+
+	pthread_mutex_lock(&cloc_cache_lock);
+	for (e = cloc_cache[slot]; e != NULL; e = e->next) {
+		if (strcmp(e->path, fileName) == 0)
+			break;
+	}
+	if (e == NULL) {
+		if (cloc_cache_count >= CLOC_CACHE_MAX)
+			cloc_cache_clear();
+		e = calloc(1, sizeof(*e));
+		e->path = strdup(fileName);
+		e->next = cloc_cache[slot];
+		cloc_cache[slot] = e;
+		cloc_cache_count++;
+	}
+	e->dev = st.st_dev;
+	e->ino = st.st_ino;
+	e->size = st.st_size;
+	e->mtime = st.st_mtim;
+	e->ctime = st.st_ctim;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 3; j++)
+			e->counts[i][j] = file_counts[i][j];
+	pthread_mutex_unlock(&cloc_cache_lock);
+}
+
+static void listFiles(int *ignored_files, int *processed_files,
+					  char *dirname, int counts[4][4]) {
+	DIR *dir = opendir(dirname);
+	if (dir == NULL) {
+		fprintf(stderr, "No folder found!\n");
+		return;
+	}
+	struct dirent *ent;
+	ent = readdir(dir);
+	while (ent != NULL) {
+		char name[256];
+		strcpy(name, ent->d_name);
+		char *ext = strrchr(name, '.');
+		if (ent->d_type == 4 && strcmp(name, ".") != 0 &&
+			strcmp(name, "..") != 0 && name[0] != '.') {
+			char path[512];
+			sprintf(path, "%s/%s", dirname, ent->d_name);
+			listFiles(ignored_files, processed_files, path, counts);
+		} else if (name[0] != '.') {
+			*processed_files += 1;
+			if (ext) {
+				if (strcmp(ext, ".py") == 0) {
+					counts[0][3] += 1;
+				} else if (strcmp(ext, ".cpp") == 0) {
+					counts[1][3] += 1;
+				} else if (strcmp(ext, ".c") == 0) {
+					counts[2][3] += 1;
+				} else {
+					counts[3][3] += 1;
+				}
+			} else {
+				counts[3][3] += 1;
+			}
+			char fileName[512];
+			sprintf(fileName, "%s/%s", dirname, ent->d_name);
+			cachedLineCount(counts, fileName);
+		} else {
+			if (strcmp(name, "..") != 0 && strcmp(name, ".") != 0) {
+				*ignored_files += 1;
+			}
+		}
+		ent = readdir(dir);
+	}
+	closedir(dir);
+}
+static int argv_count(char **argv) {
+	int argc = 0;
+	while (argv[argc] != NULL)
+		argc++;
+	return argc;
+}
+
+static int builtin_exit(char **argv, int in_fd, int out_fd) {
+	// a lone exit is handled by process_command, in a pipeline it only ends
+	// its own stage
+	(void)argv;
+	(void)in_fd;
+	(void)out_fd;
+	return 0;
+}
+
+static int builtin_cd(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	(void)out_fd;
+	int status = 0;
+	const char *target = argv[1] ? argv[1] : getenv("HOME");
+
+	int r = chdir(target ? target : "/"); // Changed to first argument
+	if (r == -1) {
+		fprintf(stderr, "-%s: %s: %s\n", sysname, argv[0], strerror(errno));
+		status = 1;
+	}
+	prompt_invalidate();
+
+	char cwdpath[256];
+	char *home_dir = getenv("HOME");
+	char full_path[256];
+	sprintf(full_path, "%s/%s", home_dir, "cdhistory.txt");
+	FILE *cdhistory = fopen(full_path, "r+");
+	char history[10][256];
+	char new_history[11][256];
+	int i = 0;
+
+	if (cdhistory != NULL) {
+		while (fscanf(cdhistory, "%s\n", history[i]) !=
+			   EOF) { //getting cd history from saved file into an array
+			i++;
+		}
+		fclose(cdhistory);
+	}
+
+	getcwd(cwdpath, sizeof(cwdpath));
+	int curr_index = 0;
+	int ex_index = 0;
+	while (ex_index < i) {
+		if (strcmp(history[ex_index], cwdpath) != 0) {
+			strcpy(new_history[curr_index],
+				   history[ex_index]); //copying unique paths into new array
+			curr_index++; //and if the new path already exists in history
+		} //we don't copy it so we can add it to the end of the file
+		ex_index++; //making it the latest unique path entry
+	}
+	strcpy(new_history[curr_index], cwdpath);
+	curr_index++;
+	cdhistory = fopen(full_path, "w");
+	if (cdhistory == NULL)
+		return status;
+	if (curr_index == 11) { //checking if we exceeded the 10 unique path limit
+		for (int c = 0; c < 10; c++) { //then take action accordingly
+			fprintf(cdhistory, "%s\n",
+					new_history[c + 1]); //deleting the oldest path
+		}
+	} else {
+		for (int c = 0; c < curr_index; c++) {
+			fprintf(cdhistory, "%s\n", new_history[c]);
+		}
+	}
+	fclose(cdhistory);
+	return status;
+}
+
+/**
+ * Read one line of a builtin's input, dropping what follows on that line.
+ * The shell's own stdin goes through stdio like the prompt, so input typed
+ * ahead stays in order; any other fd is read a byte at a time so that
+ * nothing after the line is taken from the next reader.
+ * @return line without its '\n', to be freed, NULL at end of input
+ */
+static char *read_input_line(int in_fd) {
+	char *line = NULL;
+	size_t cap = 0;
+	if (in_fd == STDIN_FILENO) {
+		ssize_t len = getline(&line, &cap, stdin);
+		if (len == -1) {
+			free(line);
+			return NULL;
+		}
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = 0;
+		return line;
+	}
+
+	size_t len = 0;
+	bool got_any = false;
+	char c;
+	for (;;) {
+		ssize_t n = read(in_fd, &c, 1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		got_any = true;
+		if (c == '\n')
+			break;
+		if (len + 2 > cap) {
+			cap = cap ? cap * 2 : 64;
+			line = realloc(line, cap);
+		}
+		line[len++] = c;
+	}
+	if (!got_any)
+		return NULL;
+	if (line == NULL)
+		line = malloc(1);
+	line[len] = 0;
+	return line;
+}
+
+static int builtin_cdh(char **argv, int in_fd, int out_fd) {
+	int status = 0;
+	char *home_dir = getenv("HOME");
+	char full_path[256];
+	sprintf(full_path, "%s/%s", home_dir, "cdhistory.txt");
+	char history[10][256];
+	FILE *cdhistory = fopen(full_path, "r");
+	char new_history[10][256];
+
+	if (cdhistory == NULL) {
+		return status;
+	}
+
+	char s = 'a';
+	int i = 0;
+	while (i < 10 && fscanf(cdhistory, "%s\n", history[i]) !=
+						 EOF) { //getting history into array
+		i++;
+	}
+	fclose(cdhistory);
+	if (i == 0)
+		return status;
+	int j = i;
+	for (int k = 0; k < j;
+		 k++) { //printing history as seen in the given example
+		dprintf(out_fd, "%c  %d)  %s\n", s + i - 1, i, history[k]);
+		i--;
+	}
+
+	char choice = 'a';
+	int choiceNum = 0;
+	dprintf(out_fd, "Select directory by letter or number: ");
+	char *line = read_input_line(in_fd); // first character decides
+	if (line != NULL)
+		choice = line[0];
+	free(line);
+
+	if (isdigit(choice) !=
+		0) { //converting choice into int to be able to index array
+		choiceNum = choice - '0';
+	} else {
+		choiceNum = choice - 'a' + 1;
+	}
+
+	choiceNum = j - choiceNum;
+	if (choiceNum < 0 || choiceNum >= j) {
+		fprintf(stderr, "-%s: %s: no such entry\n", sysname, argv[0]);
+		return 1;
+	}
+	int r = chdir(history[choiceNum]); //changing dir
+	if (r == -1) {
+		fprintf(stderr, "-%s: %s: %s\n", sysname, argv[0], strerror(errno));
+		status = 1;
+	}
+	prompt_invalidate();
+
+	int curr_index = 0;
+	int ex_index = 0;
+	while (ex_index <
+		   j) //refreshing history.txt according to the latest changed dir
+	{
+		if (strcmp(history[ex_index], history[choiceNum]) != 0) {
+			strcpy(new_history[curr_index], history[ex_index]);
+			curr_index++;
+		}
+		ex_index++;
+	}
+	strcpy(new_history[curr_index], history[choiceNum]);
+	curr_index++;
+
+	cdhistory = fopen(full_path, "w");
+	if (cdhistory == NULL)
+		return status;
+	for (int c = 0; c < curr_index; c++) {
+		fprintf(cdhistory, "%s\n", new_history[c]);
+	}
+	fclose(cdhistory);
+
+	return status;
+}
+
+#define ROLL_DICE_MAX 1000000
+
+static int builtin_roll(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	bool stats = false;
+	uint64_t seed = roll_random_seed();
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *spec = NULL;
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "--stats") == 0)
+			stats = true;
+		else if (strcmp(argv[i], "--seed") == 0 && argv[i + 1] != NULL)
+			seed = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL)
+			threads = atol(argv[++i]);
+		else if (spec == NULL)
+			spec = argv[i];
+		else
+			spec = "";
+	}
+	if (spec == NULL || spec[0] == 0) {
+		fprintf(
+			stderr,
+			"Wrong arguments! Usage: roll [<trials>x][<count>]d<sides> [--stats] [--seed <n>] [-j <threads>]\n");
+		return 2;
+	}
+
+	// [<trials>x][<count>]d<sides>
+	long long trials = 1, dice = 1;
+	bool counted = false;
+	const char *p = spec;
+	char *end;
+	long long n = strtoll(p, &end, 10);
+	if (end != p && *end == 'x') {
+		trials = n;
+		stats = true;
+		p = end + 1;
+		n = strtoll(p, &end, 10);
+	}
+	if (end != p) {
+		dice = n;
+		counted = true;
+		p = end;
+	}
+	unsigned long long sides = 0;
+	if (*p == 'd' && p[1] >= '0' && p[1] <= '9')
+		sides = strtoull(p + 1, &end, 10);
+	if (sides < 1 || sides > UINT32_MAX || *end != 0 || trials < 1 ||
+		dice < 1 || dice > ROLL_DICE_MAX) {
+		fprintf(stderr, "Error in argument.\n");
+		return 2;
+	}
+
+	if (stats) {
+		struct roll_stats result;
+		roll_simulate(trials, dice, sides, seed, threads, &result);
+		roll_report(&result, out_fd);
+		roll_stats_free(&result);
+		return 0;
+	}
+
+	// add the dice up, then replay the same stream to list them
+	struct roll_rng rng, replay;
+	roll_seed(&rng, seed, 0);
+	replay = rng;
+	unsigned long long total = 0;
+	for (long long i = 0; i < dice; i++)
+		total += roll_die(&rng, sides);
+	if (!counted) {
+		dprintf(out_fd, "Rolled %llu \n", total);
+		return 0;
+	}
+
+	char line[4096];
+	size_t len = snprintf(line, sizeof(line), "Rolled %llu (", total);
+	for (long long i = 0; i < dice; i++) {
+		if (len > sizeof(line) - 32) {
+			dprintf(out_fd, "%.*s", (int)len, line);
+			len = 0;
+		}
+		len += snprintf(line + len, sizeof(line) - len,
+						i > 0 ? " + %u" : "%u", roll_die(&replay, sides));
+	}
+	dprintf(out_fd, "%.*s)\n", (int)len, line);
+	return 0;
+}
+
+static int builtin_cloc(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	char path[512];
+	char cloc_path[1024];
+	getcwd(path, sizeof(path));
+	sprintf(cloc_path, "%s/%s", path, argv[1] ? argv[1] : ".");
+	int processed_files = 0;
+	int ignored_files = 0;
+	int counts[4][4] = {
+		{ 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }
+	};
+	//2D counts array has 4 int-arr for python,c++,c and txt(all other formats.)
+	// counts[x][0] = total #of lines of code.
+	// counts[x][1] = total #of blank lines
+	// counts[x][2] = total #of command lines.
+	// counts[x][3] = total #of files for that type.
+	listFiles(&ignored_files, &processed_files, cloc_path, counts);
+	dprintf(out_fd, "Total Number of files found: %d\n",
+			ignored_files + processed_files);
+	dprintf(out_fd, "Number of ignored files: %d\n", ignored_files);
+	dprintf(out_fd, "Number of processed files: %d\n", processed_files);
+	dprintf(out_fd, "Python; %d files, %d blank, %d command, %d code lines.\n",
+			counts[0][3], counts[0][1], counts[0][2], counts[0][0]);
+	dprintf(out_fd, "Cpp;    %d files, %d blank, %d command, %d code lines.\n",
+			counts[1][3], counts[1][1], counts[1][2], counts[1][0]);
+	dprintf(out_fd, "C;      %d files, %d blank, %d command, %d code lines.\n",
+			counts[2][3], counts[2][1], counts[2][2], counts[2][0]);
+	dprintf(out_fd, "Txt;    %d files, %d blank, %d command, %d code lines.\n",
+			counts[3][3], counts[3][1], counts[3][2], counts[3][0]);
+	int total_counts[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			total_counts[j] += counts[i][j];
+		}
+	}
+	dprintf(out_fd, "Total;  %d files, %d blank, %d command, %d code lines.\n",
+			total_counts[3], total_counts[1], total_counts[2],
+			total_counts[0]);
+	return 0;
+}
+
+static int builtin_rename(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	int argc = argv_count(argv);
+	struct stat st;
+	int status = 0;
+
+	if (argc < 3) {
+		fprintf(
+			stderr,
+			"Wrong arguments!\nUsage for mvsf(move to subfolder): mvsf <old file name>... <new file namepath>\nUsage for rename: rename <old file name> <new file name>\n");
+		return 2;
+	}
+
+	// into an existing directory, or one source onto a new name
+	const char *dest = argv[argc - 1];
+	bool to_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+	if (argc > 3 && !to_dir) {
+		fprintf(stderr, "-%s: %s: %s: %s\n", sysname, argv[0], dest,
+				strerror(ENOTDIR));
+		return 1;
+	}
+
+	int count = argc - 2;
+	struct move_job *jobs = calloc(count, sizeof(struct move_job));
+	for (int i = 0; i < count; i++) {
+		const char *from = argv[i + 1];
+		jobs[i].from = from;
+		if (to_dir) {
+			size_t len = strlen(from);
+			while (len > 1 && from[len - 1] == '/')
+				len--;
+			const char *base = memrchr(from, '/', len);
+			base = base ? base + 1 : from;
+			snprintf(jobs[i].to, sizeof(jobs[i].to), "%s/%.*s", dest,
+					 (int)(from + len - base), base);
+		} else {
+			snprintf(jobs[i].to, sizeof(jobs[i].to), "%s", dest);
+		}
+	}
+
+	int failed = move_batch(jobs, count);
+	for (int i = 0; i < count; i++) {
+		if (jobs[i].error != 0)
+			fprintf(stderr, "-%s: %s: %s: %s\n", sysname, argv[0],
+					jobs[i].from, strerror(jobs[i].error));
+	}
+	if (failed == 0 && count == 1)
+		dprintf(out_fd, "File renamed/moved successfully.\n");
+	else if (failed == 0)
+		dprintf(out_fd, "%d files moved successfully.\n", count);
+	else
+		status = 1;
+
+	free(jobs);
+	return status;
+}
+
+static int builtin_searchwords(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	char path[256];
+	char file[512];
+	char searched_word[256];
+	int word_count = 0;
+	if (argv_count(argv) != 3) {
+		fprintf(
+			stderr,
+			"Wrong arguments! Usage for searchwords: searchwords <file name> <searched word>\n.");
+		return 2;
+	}
+	getcwd(path, sizeof(path));
+	sprintf(file, "%s/%s", path, argv[1]);
+	snprintf(searched_word, sizeof(searched_word), "%s", argv[2]);
+	FILE *search_file = fopen(file, "r");
+	char word[1024];
+	if (search_file == NULL) {
+		fprintf(stderr, "Couldn't opened the file.\n");
+		return 1;
+	}
+	while (fscanf(search_file, "%1023s", word) == 1) {
+		if (strstr(word, searched_word) != 0) {
+			word_count += 1;
+		}
+	}
+	fclose(search_file);
+	dprintf(out_fd, "%s found %d times in file %s\n", searched_word,
+			word_count, argv[1]);
+	return 0;
+}
+
+/**
+ * Whether a psvis query option is one the module knows, with a value that
+ * is safe to put on the insmod command line
+ */
+static bool psvis_option(const char *arg) {
+	static const char *names[] = { "threads", "pidns", "cgroup",
+								   "max_depth", "min_size" };
+	const char *eq = strchr(arg, '=');
+	bool known = false;
+	if (eq == NULL || eq[1] == 0)
+		return false;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strlen(names[i]) == (size_t)(eq - arg) &&
+			strncmp(arg, names[i], eq - arg) == 0)
+			known = true;
+	}
+	for (const char *p = eq + 1; *p && known; p++)
+		known = isalnum((unsigned char)*p) || strchr("/._-", *p);
+	return known;
+}
+
+static int builtin_psvis(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	int argc = argv_count(argv);
+	if (argc < 3) {
+		fprintf(
+			stderr,
+			"Wrong arguments! Usage: psvis <pid> <png name> [threads=1] [pidns=<pid>] [cgroup=<path>] [max_depth=<n>] [min_size=<n>]\n");
+		return 2;
+	}
+	// query options are filtered in the kernel, passed as module params
+	char options[256] = "";
+	for (int i = 3; i < argc; i++) {
+		size_t len = strlen(options);
+		if (!psvis_option(argv[i])) {
+			fprintf(stderr, "-%s: %s: unknown option %s\n", sysname,
+					argv[0], argv[i]);
+			return 2;
+		}
+		if (len + strlen(argv[i]) + 2 > sizeof(options)) {
+			fprintf(stderr, "-%s: %s: too many options\n", sysname,
+					argv[0]);
+			return 2;
+		}
+		snprintf(options + len, sizeof(options) - len, " %s", argv[i]);
+	}
+	int root_pid = atoi(argv[1]);
+	char command_exec[512];
+	char word[256] = "0";
+	int count = 0;
+	system(
+		"sudo -S dmesg > deneme.txt"); //getting kernel modules info before inserting our module
+	system(
+		"wc -l deneme.txt > den.txt"); //getting line count of dmesg for later use of parsing
+	FILE *count_file = fopen("den.txt", "r");
+	if (count_file != NULL) {
+		fscanf(count_file, "%255s%*[^\n]",
+			   word); //getting line count value to word variable
+		fclose(count_file);
+	}
+	count = atoi(word);
+	if (kill(root_pid, 0) == -1 &&
+		errno ==
+			ESRCH) { //checking if the given pid exists to prevent module crash
+		fprintf(stderr, "Please enter a valid PID!\n");
+		return 1;
+	}
+	snprintf(command_exec, sizeof(command_exec),
+			 "sudo -S insmod mymodule.ko pid=%d%s", root_pid, options);
+	system(command_exec);
+	system("sudo -S dmesg > deneme.txt");
+	sprintf(command_exec, "sed '1,%dd' deneme.txt > deneme2.txt",
+			count); //transfering new lines after insmod
+	system(command_exec);
+	system("sudo -S rmmod mymodule"); //removing module
+
+	FILE *dmesg =
+		fopen("deneme2.txt", "r"); //writing to .gv file to be drawn
+	if (dmesg == NULL)
+		return 1;
+	FILE *write_file = fopen("deneme3.gv", "w");
+	fprintf(write_file, "digraph ProcessTree{\n");
+	char line[1024];
+	while (fgets(line, sizeof(line), dmesg)) {
+		char *p = strchr(line, '"');
+		if (p != NULL)
+			fprintf(write_file, "%s", p);
+	}
+	fprintf(write_file, "}\n");
+	fclose(dmesg);
+	fclose(write_file);
+	snprintf(
+		command_exec, sizeof(command_exec), "dot -Tpng deneme3.gv -o %s",
+		argv[2]); //creating .png using graphviz with .gv source file
+	if (system(command_exec) != 0) {
+		dprintf(out_fd, "Please install graphviz packages!\n");
+		return 1;
+	}
+	return 0;
+	// Elimize saglik.
+}
+
+static int builtin_timing(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	int argc = argv_count(argv);
+
+	// timing on|off: report every command as if prefixed with time
+	if (argc == 2 && strcmp(argv[1], "on") == 0) {
+		timing_always = true;
+	} else if (argc == 2 && strcmp(argv[1], "off") == 0) {
+		timing_always = false;
+	} else if (argc == 1) {
+		dprintf(out_fd, "timing is %s\n", timing_always ? "on" : "off");
+	} else {
+		fprintf(stderr, "Usage: timing [on|off]\n");
+		return 2;
+	}
+	return 0;
+}
+
+static int builtin_mstat(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	int argc = argv_count(argv);
+
+	// mstat [-h] [--reset] [--chrome <file>]
+	int histograms = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-h") == 0) {
+			histograms = 1;
+		} else if (strcmp(argv[i], "--reset") == 0) {
+			trace_reset();
+			return 0;
+		} else if (strcmp(argv[i], "--chrome") == 0 && i + 1 < argc) {
+			if (trace_export_chrome(argv[++i]) == -1) {
+				fprintf(stderr, "-%s: %s: %s: %s\n", sysname, argv[0],
+						argv[i], strerror(errno));
+				return 1;
+			}
+			return 0;
+		} else {
+			fprintf(stderr, "Usage: mstat [-h] [--reset] [--chrome <file>]\n");
+			return 2;
+		}
+	}
+	trace_print_stats(out_fd, histograms);
+	return 0;
+}
+
+static int builtin_export(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	(void)out_fd;
+	int status = 0;
+
+	// export NAME=VALUE ...
+	for (int i = 1; argv[i] != NULL; i++) {
+		char *eq = strchr(argv[i], '=');
+		if (eq == NULL || eq == argv[i]) {
+			fprintf(stderr, "-%s: export: `%s': not a valid identifier\n",
+					sysname, argv[i]);
+			status = 1;
+			continue;
+		}
+		*eq = 0;
+		setenv(argv[i], eq + 1, 1);
+		*eq = '=';
+	}
+	prompt_invalidate();
+	return status;
+}
+
+static int builtin_unset(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	(void)out_fd;
+	for (int i = 1; argv[i] != NULL; i++)
+		unsetenv(argv[i]);
+	prompt_invalidate();
+	return 0;
+}
+
+/**
+ * Report a failed copy; a reader that went away is not worth a message
+ */
+static int copy_error(const char *name, const char *path) {
+	if (errno != EPIPE)
+		fprintf(stderr, "-%s: %s: %s: %s\n", sysname, name, path,
+				strerror(errno));
+	return 1;
+}
+
+static int builtin_cat(char **argv, int in_fd, int out_fd) {
+	int status = 0;
+	if (argv[1] == NULL && copy_fd(in_fd, out_fd) == -1)
+		return copy_error(argv[0], "stdin");
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-") == 0) {
+			if (copy_fd(in_fd, out_fd) == -1)
+				status = copy_error(argv[0], "stdin");
+			continue;
+		}
+		int fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+		if (fd == -1) {
+			status = copy_error(argv[0], argv[i]);
+			continue;
+		}
+		ssize_t n = copy_fd(fd, out_fd);
+		close(fd);
+		if (n == -1) {
+			status = copy_error(argv[0], argv[i]);
+			if (errno == EPIPE)
+				break;
+		}
+	}
+	return status;
+}
+
+static int builtin_tee(char **argv, int in_fd, int out_fd) {
+	int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	int status = 0;
+	// builtin_for only lets -a through
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (argv[i][0] == '-' && argv[i][1])
+			flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+	}
+
+	int *fds = malloc(sizeof(int) * (argv_count(argv) + 1));
+	int count = 0;
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (argv[i][0] == '-' && argv[i][1])
+			continue;
+		int fd = open(argv[i], flags, 0644);
+		if (fd == -1)
+			status = copy_error(argv[0], argv[i]);
+		else
+			fds[count++] = fd;
+	}
+	fds[count++] = out_fd;
+
+	if (copy_tee(in_fd, fds, count) == -1)
+		status = copy_error(argv[0], "stdin");
+	for (int i = 0; i < count - 1; i++)
+		close(fds[i]);
+	free(fds);
+	return status;
+}
+
+static int builtin_cp(char **argv, int in_fd, int out_fd) {
+	(void)in_fd;
+	(void)out_fd;
+	int argc = argv_count(argv);
+	struct stat st;
+	int status = 0;
+	if (argc < 3) {
+		fprintf(stderr, "Wrong arguments! Usage: cp <source> <destination>\n"
+						"       cp <source>... <directory>\n");
+		return 2;
+	}
+
+	const char *dest = argv[argc - 1];
+	bool to_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+	if (argc > 3 && !to_dir) {
+		fprintf(stderr, "-%s: %s: %s: %s\n", sysname, argv[0], dest,
+				strerror(ENOTDIR));
+		return 1;
+	}
+	for (int i = 1; i < argc - 1; i++) {
+		char path[PATH_MAX];
+		if (to_dir) {
+			const char *base = strrchr(argv[i], '/');
+			snprintf(path, sizeof(path), "%s/%s", dest,
+					 base ? base + 1 : argv[i]);
+		} else {
+			snprintf(path, sizeof(path), "%s", dest);
+		}
+		if (copy_file(argv[i], path) == -1)
+			status = copy_error(argv[0], argv[i]);
+	}
+	return status;
+}
+
+/**
+ * Split everything readable from fd into lines, for parallel's inputs
+ * @return number of lines, *lines and *data are to be freed by the caller
+ */
+static int read_lines(int fd, char ***lines, char **data) {
+	size_t len = 0, cap = 65536;
+	char *buf = malloc(cap);
+	for (;;) {
+		if (cap - len < 4096)
+			buf = realloc(buf, cap *= 2);
+		ssize_t n = read(fd, buf + len, cap - len - 1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+	}
+	buf[len] = 0;
+
+	int count = 0, capacity = 64;
+	char **list = malloc(sizeof(char *) * capacity);
+	for (char *line = buf; line < buf + len;) {
+		char *end = strchr(line, '\n');
+		if (end != NULL)
+			*end = 0;
+		if (*line) {
+			if (count == capacity)
+				list = realloc(list, sizeof(char *) * (capacity *= 2));
+			list[count++] = line;
+		}
+		line = end ? end + 1 : buf + len;
+	}
+	*lines = list;
+	*data = buf;
+	return count;
+}
+
+static int builtin_parallel(char **argv, int in_fd, int out_fd) {
+	long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	bool keep_order = false;
+	int i = 1;
+
+	for (; argv[i] != NULL && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-k") == 0)
+			keep_order = true;
+		else if (strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL)
+			max_jobs = atol(argv[++i]);
+		else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2])
+			max_jobs = atol(argv[i] + 2);
+		else
+			break;
+	}
+	int first = i;
+	while (argv[i] != NULL && strcmp(argv[i], ":::") != 0)
+		i++;
+	if (i == first) {
+		fprintf(
+			stderr,
+			"Wrong arguments! Usage: parallel [-j jobs] [-k] <command> [{}]... [::: <input>...]\n"
+			"Without ::: the inputs are the lines of stdin. -k keeps the output in input order.\n");
+		return 2;
+	}
+
+	// every job holds a pidfd and a pipe while it runs
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+		limit.rlim_cur != RLIM_INFINITY &&
+		max_jobs > (long)(limit.rlim_cur - 16) / 3)
+		max_jobs = (limit.rlim_cur - 16) / 3;
+	if (max_jobs < 1)
+		max_jobs = 1;
+
+	char **template = calloc(i - first + 1, sizeof(char *));
+	memcpy(template, &argv[first], sizeof(char *) * (i - first));
+
+	char **inputs, *data = NULL;
+	int count, job_in_fd = in_fd;
+	if (argv[i] != NULL) {
+		inputs = &argv[i + 1];
+		count = argv_count(inputs);
+	} else {
+		count = read_lines(in_fd, &inputs, &data);
+		// stdin went to us, not to the jobs
+		job_in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	}
+
+	int status = parallel_run(template, inputs, count, max_jobs, keep_order,
+							  job_in_fd, out_fd);
+
+	if (data != NULL) {
+		free(inputs);
+		free(data);
+		close(job_in_fd);
+	}
+	free(template);
+	return status;
+}
+
+static int builtin_watch_run(char **argv, int in_fd, int out_fd) {
+	int quiet_ms = 100;
+	int i = 1;
+	if (argv[i] != NULL && strcmp(argv[i], "-q") == 0 && argv[i + 1]) {
+		quiet_ms = atoi(argv[i + 1]);
+		i += 2;
+	}
+	int first = i;
+	while (argv[i] != NULL && strcmp(argv[i], "--") != 0)
+		i++;
+	if (i == first || argv[i] == NULL || argv[i + 1] == NULL ||
+		quiet_ms < 0) {
+		fprintf(
+			stderr,
+			"Wrong arguments! Usage: watch-run [-q quiet ms] <path>... -- <command>\n"
+			"Runs the command, then again after every change below the paths.\n");
+		return 2;
+	}
+
+	size_t len = 1;
+	for (int j = i + 1; argv[j] != NULL; j++)
+		len += strlen(argv[j]) + 1;
+	char *line = calloc(1, len);
+	for (int j = i + 1; argv[j] != NULL; j++) {
+		if (j > i + 1)
+			strcat(line, " ");
+		strcat(line, argv[j]);
+	}
+	char **paths = calloc(i - first + 1, sizeof(char *));
+	memcpy(paths, &argv[first], sizeof(char *) * (i - first));
+
+	// the watcher is a child of its own, the cache goes with it
+	cloc_cache_enabled = true;
+	int status = watch_run(paths, line, quiet_ms, in_fd, out_fd);
+	cloc_cache_enabled = false;
+
+	free(paths);
+	free(line);
+	return status;
+}
+
+static const struct builtin builtins[] = {
+	{ "cat", builtin_cat, BUILTIN_THREAD, "" },
+	{ "cd", builtin_cd, BUILTIN_SHELL, NULL },
+	{ "cdh", builtin_cdh, BUILTIN_SHELL, NULL },
+	{ "cloc", builtin_cloc, BUILTIN_THREAD, NULL },
+	{ "cp", builtin_cp, BUILTIN_THREAD, "" },
+	{ "exit", builtin_exit, BUILTIN_SHELL, NULL },
+	{ "export", builtin_export, BUILTIN_SHELL, NULL },
+	{ "mstat", builtin_mstat, BUILTIN_THREAD, NULL },
+	{ "mvsf", builtin_rename, BUILTIN_THREAD, NULL },
+	{ "parallel", builtin_parallel, 0, NULL },
+	{ "psvis", builtin_psvis, 0, NULL },
+	{ "rename", builtin_rename, BUILTIN_THREAD, NULL },
+	{ "roll", builtin_roll, 0, NULL },
+	{ "searchwords", builtin_searchwords, BUILTIN_THREAD, NULL },
+	{ "tee", builtin_tee, BUILTIN_THREAD, "a" },
+	{ "timing", builtin_timing, BUILTIN_SHELL, NULL },
+	{ "unset", builtin_unset, BUILTIN_SHELL, NULL },
+	{ "watch-run", builtin_watch_run, 0, NULL },
+};
+#define BUILTIN_COUNT ((int)(sizeof(builtins) / sizeof(builtins[0])))
+
+/*
+ * Perfect hash over the builtin names: on first use a seed is searched for
+ * that maps every name to its own slot, so a lookup is one hash and at
+ * most one strcmp, for builtins and external commands alike.
+ */
+#define BUILTIN_SLOTS_MAX 1024
+
+static const struct builtin *slots[BUILTIN_SLOTS_MAX];
+static unsigned int slot_mask;
+static unsigned int hash_seed;
+
+static unsigned int hash_name(const char *name, unsigned int seed) {
+	unsigned int h = 2166136261u ^ seed; // FNV-1a
+	for (; *name; name++) {
+		h ^= (unsigned char)*name;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+static void builtins_build_hash(void) {
+	unsigned int size = 1;
+	while (size < 2 * BUILTIN_COUNT)
+		size *= 2;
+
+	for (; size <= BUILTIN_SLOTS_MAX; size *= 2) {
+		for (unsigned int seed = 1; seed < 10000; seed++) {
+			bool collision = false;
+			memset(slots, 0, sizeof(slots));
+			for (int i = 0; i < BUILTIN_COUNT && !collision; i++) {
+				unsigned int h = hash_name(builtins[i].name, seed) & (size - 1);
+				if (slots[h] != NULL)
+					collision = true;
+				slots[h] = &builtins[i];
+			}
+			if (!collision) {
+				slot_mask = size - 1;
+				hash_seed = seed;
+				return;
+			}
+		}
+	}
+}
+
+const struct builtin *builtin_lookup(const char *name) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, builtins_build_hash);
+
+	const struct builtin *b = slots[hash_name(name, hash_seed) & slot_mask];
+	if (b != NULL && strcmp(b->name, name) == 0)
+		return b;
+	return NULL;
+}
+
+const struct builtin *builtin_for(char **argv) {
+	const struct builtin *b = builtin_lookup(argv[0]);
+	if (b == NULL || b->options == NULL)
+		return b;
+	for (int i = 1; argv[i] != NULL; i++) {
+		// a lone "-" is stdin, not an option
+		if (argv[i][0] != '-' || argv[i][1] == 0)
+			continue;
+		if (argv[i][1] == '-')
+			return NULL; // long options and "--"
+		for (const char *o = argv[i] + 1; *o; o++) {
+			if (strchr(b->options, *o) == NULL)
+				return NULL;
+		}
+	}
+	return b;
+}
+
+const char *builtin_name(int index) {
+	return index < BUILTIN_COUNT ? builtins[index].name : NULL;
+}
+
+int builtin_run(const struct builtin *builtin, char **argv, int in_fd,
+				int out_fd) {
+	long long span = trace_begin();
+	int status = builtin->fn(argv, in_fd, out_fd);
+	trace_end(TRACE_BUILTIN, builtin->name, span);
+	return status;
+}
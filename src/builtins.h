@@ -0,0 +1,58 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+/**
+ * Every builtin reads from in_fd and writes its output to out_fd, so it can
+ * run in the shell, on a thread as a pipeline stage, or in a forked child.
+ * Diagnostics go to stderr.
+ * @param  argv   NULL terminated arguments, argv[0] is the builtin name
+ * @param  in_fd  fd to read input from
+ * @param  out_fd fd to write output to
+ * @return        exit status
+ */
+typedef int (*builtin_fn)(char **argv, int in_fd, int out_fd);
+
+enum builtin_flags {
+	BUILTIN_SHELL = 1, // changes the shell's own state (cwd, environment)
+	BUILTIN_THREAD = 2, // safe to run on a thread next to the shell
+};
+
+struct builtin {
+	const char *name;
+	builtin_fn fn;
+	int flags;
+	// for a builtin standing in for an external tool: the option letters
+	// it knows; any other option runs the external tool. NULL otherwise.
+	const char *options;
+};
+
+/**
+ * Find a builtin by name through a perfect hash over the builtin table
+ * @param  name command name
+ * @return      the builtin, NULL if name is not one
+ */
+const struct builtin *builtin_lookup(const char *name);
+
+/**
+ * The builtin to run for a command line. A builtin standing in for an
+ * external tool, like cat or cp, gives way to the tool when an argument is
+ * an option it doesn't take.
+ * @param  argv NULL terminated arguments, argv[0] is the command name
+ * @return      the builtin, NULL to run an external command
+ */
+const struct builtin *builtin_for(char **argv);
+
+/**
+ * Name of the index-th builtin, for completion
+ * @return NULL past the last builtin
+ */
+const char *builtin_name(int index);
+
+/**
+ * Run a builtin and record a trace span for it
+ * @return exit status of the builtin
+ */
+int builtin_run(const struct builtin *builtin, char **argv, int in_fd,
+				int out_fd);
+
+#endif
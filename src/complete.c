@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "complete.h"
+#include "dirscan.h"
+
+// more candidates than this asks before flooding the terminal
+#define COMPLETE_ASK_LIMIT 100
+
+// words completed as commands besides the builtins and PATH
+static const char *keywords[] = { "run", "time", NULL };
+
+/*
+ * PATH index: a first-child/next-sibling trie kept in one growable array,
+ * siblings sorted by character so a depth first walk yields sorted names.
+ */
+struct trie_node {
+	char c;
+	bool terminal;
+	int child;
+	int sibling;
+};
+
+struct path_dir {
+	char *name;
+	struct timespec mtime;
+	bool present;
+};
+
+static struct trie_node *trie;
+static int trie_len, trie_cap;
+static char *indexed_path; // PATH value the index was built from
+static struct path_dir *path_dirs;
+static int path_dir_count;
+
+struct candidates {
+	char **names;
+	int count, cap;
+};
+
+static int trie_new_node(char c) {
+	if (trie_len == trie_cap) {
+		trie_cap = trie_cap ? trie_cap * 2 : 4096;
+		trie = realloc(trie, sizeof(struct trie_node) * trie_cap);
+	}
+	trie[trie_len] = (struct trie_node){ c, false, -1, -1 };
+	return trie_len++;
+}
+
+static void trie_insert(const char *word) {
+	int node = 0; // root
+	for (; *word; word++) {
+		int *link = &trie[node].child;
+		while (*link != -1 && trie[*link].c < *word)
+			link = &trie[*link].sibling;
+		if (*link == -1 || trie[*link].c != *word) {
+			int n = trie_new_node(*word); // may move trie
+			link = &trie[node].child;
+			while (*link != -1 && trie[*link].c < *word)
+				link = &trie[*link].sibling;
+			trie[n].sibling = *link;
+			*link = n;
+		}
+		node = *link;
+	}
+	trie[node].terminal = true;
+}
+
+static void candidates_add(struct candidates *cands, const char *name,
+						   size_t len, bool slash) {
+	if (cands->count == cands->cap) {
+		cands->cap = cands->cap ? cands->cap * 2 : 64;
+		cands->names = realloc(cands->names, sizeof(char *) * cands->cap);
+	}
+	char *copy = malloc(len + 2);
+	memcpy(copy, name, len);
+	if (slash)
+		copy[len++] = '/';
+	copy[len] = 0;
+	cands->names[cands->count++] = copy;
+}
+
+static void candidates_free(struct candidates *cands) {
+	for (int i = 0; i < cands->count; i++)
+		free(cands->names[i]);
+	free(cands->names);
+}
+
+static void trie_collect(int node, char *word, size_t len,
+						 struct candidates *cands) {
+	for (int n = trie[node].child; n != -1; n = trie[n].sibling) {
+		if (len + 1 >= 4096)
+			continue;
+		word[len] = trie[n].c;
+		if (trie[n].terminal)
+			candidates_add(cands, word, len + 1, false);
+		trie_collect(n, word, len + 1, cands);
+	}
+}
+
+static int index_executable(const char *name, unsigned char type, void *arg) {
+	int dirfd = *(int *)arg;
+	struct stat st;
+
+	if (type == DT_DIR)
+		return 0;
+	if (type == DT_LNK || type == DT_UNKNOWN) {
+		if (fstatat(dirfd, name, &st, 0) == -1 || !S_ISREG(st.st_mode))
+			return 0;
+	}
+	if (faccessat(dirfd, name, X_OK, 0) == 0)
+		trie_insert(name);
+	return 0;
+}
+
+static void path_index_clear(void) {
+	for (int i = 0; i < path_dir_count; i++)
+		free(path_dirs[i].name);
+	free(path_dirs);
+	free(indexed_path);
+	path_dirs = NULL;
+	path_dir_count = 0;
+	indexed_path = NULL;
+	trie_len = 0;
+}
+
+/**
+ * Whether PATH or the mtime of one of its directories changed since
+ * the index was built. Costs one stat per PATH entry, no directory reads.
+ */
+static bool path_index_stale(const char *path) {
+	if (indexed_path == NULL || strcmp(indexed_path, path) != 0)
+		return true;
+	for (int i = 0; i < path_dir_count; i++) {
+		struct stat st;
+		bool present = stat(path_dirs[i].name, &st) == 0;
+		if (present != path_dirs[i].present)
+			return true;
+		if (present && (st.st_mtim.tv_sec != path_dirs[i].mtime.tv_sec ||
+						st.st_mtim.tv_nsec != path_dirs[i].mtime.tv_nsec))
+			return true;
+	}
+	return false;
+}
+
+static void path_index_build(const char *path) {
+	path_index_clear();
+	indexed_path = strdup(path);
+	trie_new_node(0); // root
+
+	for (int i = 0; builtin_name(i); i++)
+		trie_insert(builtin_name(i));
+	for (int i = 0; keywords[i]; i++)
+		trie_insert(keywords[i]);
+
+	char *pathcpy = strdup(path);
+	char *save = NULL;
+	for (char *dir = strtok_r(pathcpy, ":", &save); dir;
+		 dir = strtok_r(NULL, ":", &save)) {
+		path_dirs = realloc(path_dirs,
+							sizeof(struct path_dir) * (path_dir_count + 1));
+		struct path_dir *pd = &path_dirs[path_dir_count++];
+		struct stat st;
+		pd->name = strdup(dir);
+		pd->present = stat(dir, &st) == 0;
+		if (!pd->present)
+			continue;
+		pd->mtime = st.st_mtim;
+
+		int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dirfd == -1)
+			continue;
+		dirscan(dirfd, ".", index_executable, &dirfd);
+		close(dirfd);
+	}
+	free(pathcpy);
+}
+
+static void complete_command(const char *prefix, struct candidates *cands) {
+	const char *path = getenv("PATH");
+	if (path == NULL)
+		path = "";
+	if (path_index_stale(path))
+		path_index_build(path);
+
+	// walk down to the node spelling the prefix
+	int node = 0;
+	for (const char *p = prefix; *p && node != -1; p++) {
+		int n = trie[node].child;
+		while (n != -1 && trie[n].c < *p)
+			n = trie[n].sibling;
+		node = (n != -1 && trie[n].c == *p) ? n : -1;
+	}
+	if (node == -1)
+		return;
+
+	char word[4096];
+	size_t len = strlen(prefix);
+	memcpy(word, prefix, len);
+	if (node != 0 && trie[node].terminal)
+		candidates_add(cands, word, len, false);
+	trie_collect(node, word, len, cands);
+}
+
+struct file_match {
+	int dirfd;
+	const char *prefix;
+	size_t prefix_len;
+	struct candidates *cands;
+};
+
+static int match_file(const char *name, unsigned char type, void *arg) {
+	struct file_match *m = arg;
+	if (strncmp(name, m->prefix, m->prefix_len) != 0)
+		return 0;
+	if (name[0] == '.' && m->prefix_len == 0)
+		return 0; // hidden files only when asked for
+	candidates_add(m->cands, name, strlen(name),
+				   dirscan_is_dir(m->dirfd, name, type));
+	return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void complete_file(const char *word, struct candidates *cands) {
+	const char *slash = strrchr(word, '/');
+	char dir[4096];
+	const char *prefix = word;
+
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else {
+		size_t dir_len = slash - word + 1;
+		if (dir_len >= sizeof(dir))
+			return;
+		memcpy(dir, word, dir_len);
+		dir[dir_len] = 0;
+		prefix = slash + 1;
+	}
+
+	int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd == -1)
+		return;
+	struct file_match m = { dirfd, prefix, strlen(prefix), cands };
+	dirscan(dirfd, ".", match_file, &m);
+	close(dirfd);
+
+	qsort(cands->names, cands->count, sizeof(char *), compare_names);
+}
+
+/**
+ * Print candidates column-major in as many columns as the terminal fits
+ */
+static void print_columns(struct candidates *cands) {
+	struct winsize ws;
+	int term_width = 80;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+		term_width = ws.ws_col;
+
+	int width = 0;
+	for (int i = 0; i < cands->count; i++) {
+		int len = strlen(cands->names[i]);
+		if (len > width)
+			width = len;
+	}
+	width += 2;
+
+	int cols = term_width / width;
+	if (cols < 1)
+		cols = 1;
+	int rows = (cands->count + cols - 1) / cols;
+
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < cols; c++) {
+			int i = c * rows + r;
+			if (i >= cands->count)
+				break;
+			if (c == cols - 1 || i + rows >= cands->count)
+				printf("%s", cands->names[i]);
+			else
+				printf("%-*s", width, cands->names[i]);
+		}
+		putchar('\n');
+	}
+}
+
+static bool ask_to_list(int count) {
+	printf("\nDisplay all %d possibilities? (y or n)", count);
+	fflush(stdout);
+	int c = getchar();
+	while (c != EOF && c != 'y' && c != 'n' && c != 'Y' && c != 'N')
+		c = getchar();
+	return c == 'y' || c == 'Y';
+}
+
+int complete_line(char *buf, size_t *index, size_t buf_size) {
+	size_t start = *index;
+	while (start > 0 && buf[start - 1] != ' ' && buf[start - 1] != '\t')
+		start--;
+
+	// a word is a command when nothing but a pipe precedes it
+	size_t before = start;
+	while (before > 0 && (buf[before - 1] == ' ' || buf[before - 1] == '\t'))
+		before--;
+	bool command_position = before == 0 || buf[before - 1] == '|';
+
+	char word[4096];
+	size_t word_len = *index - start;
+	memcpy(word, buf + start, word_len);
+	word[word_len] = 0;
+
+	struct candidates cands = { NULL, 0, 0 };
+	const char *base = word;
+	if (command_position && strchr(word, '/') == NULL) {
+		complete_command(word, &cands);
+	} else {
+		complete_file(word, &cands);
+		if (strrchr(word, '/'))
+			base = strrchr(word, '/') + 1;
+	}
+
+	int redraw = 0;
+	if (cands.count == 0) {
+		putchar('\a');
+		candidates_free(&cands);
+		return 0;
+	}
+
+	// longest common prefix of every candidate
+	size_t base_len = strlen(base);
+	size_t common = strlen(cands.names[0]);
+	for (int i = 1; i < cands.count; i++) {
+		size_t j = 0;
+		while (j < common && cands.names[i][j] == cands.names[0][j])
+			j++;
+		common = j;
+	}
+
+	for (size_t i = base_len; i < common && *index < buf_size - 2; i++) {
+		buf[(*index)++] = cands.names[0][i];
+		putchar(cands.names[0][i]);
+	}
+
+	if (cands.count == 1) {
+		// unique match, finish the word unless it is a directory
+		if (cands.names[0][common - 1] != '/' && *index < buf_size - 2) {
+			buf[(*index)++] = ' ';
+			putchar(' ');
+		}
+	} else if (common == base_len) {
+		if (cands.count <= COMPLETE_ASK_LIMIT || ask_to_list(cands.count)) {
+			putchar('\n');
+			print_columns(&cands);
+		} else {
+			putchar('\n');
+		}
+		redraw = 1;
+	}
+
+	candidates_free(&cands);
+	return redraw;
+}
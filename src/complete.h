@@ -0,0 +1,19 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+/**
+ * Complete the word that ends at *index in buf.
+ * Commands are completed from a cached index of the executables in PATH,
+ * anything else (or anything with a '/') is completed as a filename.
+ * The inserted characters are echoed to the terminal.
+ * @param  buf      line being edited
+ * @param  index    cursor position, advanced past inserted characters
+ * @param  buf_size capacity of buf
+ * @return          1 if a candidate list was printed and the prompt line
+ *                  needs to be redrawn, 0 otherwise
+ */
+int complete_line(char *buf, size_t *index, size_t buf_size);
+
+#endif
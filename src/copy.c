@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copy.h"
+
+#define COPY_CHUNK (1 << 30) // per copy_file_range call
+#define SPLICE_CHUNK (1 << 20)
+#define BUFFER_SIZE (128 * 1024)
+
+/*
+ * Each kernel path returns the bytes it moved, or -1. errno is left as
+ * EINVAL/EXDEV/... when the pair of fds is simply not supported, so the
+ * caller can carry on with the next method from the current offsets.
+ */
+static bool unsupported(int err) {
+	return err == EINVAL || err == EXDEV || err == ENOSYS ||
+		   err == EOPNOTSUPP || err == EBADF;
+}
+
+static ssize_t copy_range(int in_fd, int out_fd, ssize_t *total) {
+	for (;;) {
+		ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK, 0);
+		if (n == 0)
+			return 0;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		*total += n;
+	}
+}
+
+static ssize_t copy_splice(int in_fd, int out_fd, ssize_t *total) {
+	for (;;) {
+		ssize_t n = splice(in_fd, NULL, out_fd, NULL, SPLICE_CHUNK,
+						   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n == 0)
+			return 0;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		*total += n;
+	}
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * read/write fallback, also used for tee when the input is not a pipe
+ */
+static ssize_t copy_buffered(int in_fd, const int *out_fds, int count,
+							 ssize_t *total) {
+	char *buf = malloc(BUFFER_SIZE);
+	ssize_t status = 0;
+	if (buf == NULL)
+		return -1;
+	for (;;) {
+		ssize_t n = read(in_fd, buf, BUFFER_SIZE);
+		if (n == 0)
+			break;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			status = -1;
+			break;
+		}
+		for (int i = 0; i < count; i++) {
+			if (write_all(out_fds[i], buf, n) == -1) {
+				status = -1;
+				break;
+			}
+		}
+		if (status == -1)
+			break;
+		*total += n;
+	}
+	free(buf);
+	return status;
+}
+
+ssize_t copy_fd(int in_fd, int out_fd) {
+	struct stat in_st, out_st;
+	ssize_t total = 0;
+
+	if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1)
+		return -1;
+
+	if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+		if (copy_range(in_fd, out_fd, &total) == 0)
+			return total;
+		if (!unsupported(errno))
+			return -1;
+	}
+	if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+		if (copy_splice(in_fd, out_fd, &total) == 0)
+			return total;
+		if (!unsupported(errno))
+			return -1;
+	}
+	if (copy_buffered(in_fd, &out_fd, 1, &total) == -1)
+		return -1;
+	return total;
+}
+
+/**
+ * splice exactly len bytes, which are known to be waiting in the pipe
+ * in_fd. Outputs splice can't write to (ttys, O_APPEND files) get them
+ * through a buffer instead.
+ */
+static int splice_exact(int in_fd, int out_fd, size_t len) {
+	char buf[4096];
+	while (len > 0) {
+		ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+		if (n == -1 && unsupported(errno)) {
+			n = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+			if (n > 0 && write_all(out_fd, buf, n) == -1)
+				return -1;
+		}
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0) {
+			errno = EIO;
+			return -1;
+		}
+		len -= n;
+	}
+	return 0;
+}
+
+ssize_t copy_tee(int in_fd, const int *out_fds, int count) {
+	struct stat st;
+	ssize_t total = 0;
+	int scratch[2];
+
+	if (count == 1)
+		return copy_fd(in_fd, out_fds[0]);
+	if (fstat(in_fd, &st) == -1)
+		return -1;
+	if (count == 0 || !S_ISFIFO(st.st_mode) || pipe2(scratch, O_CLOEXEC) == -1)
+		goto buffered;
+
+	// the scratch pipe must take whatever tee duplicates in one go, since
+	// tee always starts again from the head of the input pipe
+	int size = fcntl(in_fd, F_GETPIPE_SZ);
+	if (size > 0)
+		fcntl(scratch[1], F_SETPIPE_SZ, size);
+
+	ssize_t status = 0;
+	for (;;) {
+		// every output but the last gets a duplicate through the scratch
+		// pipe, the last one consumes the input
+		ssize_t n = tee(in_fd, scratch[1], SPLICE_CHUNK, 0);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && total == 0 && unsupported(errno)) {
+			close(scratch[0]);
+			close(scratch[1]);
+			goto buffered;
+		}
+		if (n <= 0) {
+			status = n;
+			break;
+		}
+		for (int i = 0; i < count - 1 && status == 0; i++) {
+			ssize_t m = n;
+			if (i > 0) {
+				do
+					m = tee(in_fd, scratch[1], n, 0);
+				while (m == -1 && errno == EINTR);
+			}
+			if (m != n) {
+				if (m != -1)
+					errno = EIO;
+				status = -1;
+			} else if (splice_exact(scratch[0], out_fds[i], n) == -1) {
+				status = -1;
+			}
+		}
+		if (status == -1 || splice_exact(in_fd, out_fds[count - 1], n) == -1) {
+			status = -1;
+			break;
+		}
+		total += n;
+	}
+	int saved_errno = errno;
+	close(scratch[0]);
+	close(scratch[1]);
+	errno = saved_errno;
+	return status == -1 ? -1 : total;
+
+buffered:
+	if (copy_buffered(in_fd, out_fds, count, &total) == -1)
+		return -1;
+	return total;
+}
+
+int copy_file(const char *from, const char *to) {
+	struct stat st;
+	int in_fd = open(from, O_RDONLY | O_CLOEXEC);
+	if (in_fd == -1)
+		return -1;
+	if (fstat(in_fd, &st) == -1) {
+		close(in_fd);
+		return -1;
+	}
+	int out_fd = open(to, O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 07777);
+	if (out_fd == -1) {
+		close(in_fd);
+		return -1;
+	}
+	// truncate only once we know it isn't the source itself
+	struct stat out_st;
+	int status = fstat(out_fd, &out_st);
+	if (status == 0 && out_st.st_dev == st.st_dev &&
+		out_st.st_ino == st.st_ino) {
+		errno = EINVAL;
+		status = -1;
+	}
+	if (status == 0)
+		status = ftruncate(out_fd, 0);
+	if (status == 0 && copy_fd(in_fd, out_fd) == -1)
+		status = -1;
+	int saved_errno = errno;
+	close(in_fd);
+	if (close(out_fd) == -1 && status == 0)
+		return -1;
+	errno = saved_errno;
+	return status;
+}
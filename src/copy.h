@@ -0,0 +1,35 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <sys/types.h>
+
+/**
+ * Copy everything from in_fd to out_fd, keeping the data in the kernel
+ * where the pair allows it: copy_file_range between regular files, splice
+ * when either side is a pipe, read/write otherwise
+ * @param  in_fd  fd to read from, up to end of file
+ * @param  out_fd fd to write to
+ * @return        bytes copied, -1 with errno set on failure
+ */
+ssize_t copy_fd(int in_fd, int out_fd);
+
+/**
+ * Copy everything from in_fd to every one of out_fds. When in_fd is a pipe
+ * the data is duplicated with tee(2) and spliced out, otherwise it goes
+ * through one user space buffer
+ * @param  in_fd   fd to read from, up to end of file
+ * @param  out_fds fds to write to
+ * @param  count   number of fds in out_fds
+ * @return         bytes read from in_fd, -1 with errno set on failure
+ */
+ssize_t copy_tee(int in_fd, const int *out_fds, int count);
+
+/**
+ * Copy a regular file to a new path, keeping its permission bits
+ * @param  from source path
+ * @param  to   destination path, replaced if it exists
+ * @return      0, -1 with errno set on failure
+ */
+int copy_file(const char *from, const char *to);
+
+#endif
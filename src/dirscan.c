@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dirscan.h"
+
+// big enough that a directory with 100k entries takes a handful of syscalls
+#define DIRSCAN_BUF_SIZE (256 * 1024)
+
+int dirscan(int dirfd, const char *path, dirscan_fn fn, void *arg) {
+	int fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	char *buf = malloc(DIRSCAN_BUF_SIZE);
+	if (buf == NULL) {
+		close(fd);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int status = 0;
+	while (1) {
+		ssize_t n = getdents64(fd, buf, DIRSCAN_BUF_SIZE);
+		if (n == -1) {
+			status = -1;
+			break;
+		}
+		if (n == 0)
+			break;
+
+		ssize_t pos = 0;
+		bool stop = false;
+		while (pos < n) {
+			struct dirent64 *ent = (struct dirent64 *)(buf + pos);
+			pos += ent->d_reclen;
+			const char *name = ent->d_name;
+			if (name[0] == '.' &&
+				(name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+				continue;
+			if (fn(name, ent->d_type, arg) != 0) {
+				stop = true;
+				break;
+			}
+		}
+		if (stop)
+			break;
+	}
+
+	int saved = errno;
+	free(buf);
+	close(fd);
+	errno = saved;
+	return status;
+}
+
+bool dirscan_is_dir(int dirfd, const char *name, unsigned char type) {
+	if (type == DT_DIR)
+		return true;
+	if (type != DT_UNKNOWN && type != DT_LNK)
+		return false;
+	struct stat st;
+	if (fstatat(dirfd, name, &st, 0) == -1)
+		return false;
+	return S_ISDIR(st.st_mode);
+}
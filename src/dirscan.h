@@ -0,0 +1,31 @@
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <stdbool.h>
+
+/**
+ * Callback for every entry of a scanned directory ("." and ".." skipped)
+ * @param  name entry name
+ * @param  type d_type of the entry (DT_UNKNOWN on some filesystems)
+ * @param  arg  user pointer given to dirscan
+ * @return      0 to continue, anything else stops the scan
+ */
+typedef int (*dirscan_fn)(const char *name, unsigned char type, void *arg);
+
+/**
+ * Read a directory with large getdents64 batches
+ * @param  dirfd directory fd path is relative to (AT_FDCWD for cwd)
+ * @param  path  directory to scan
+ * @param  fn    called once per entry
+ * @param  arg   passed to fn
+ * @return       0 on success, -1 with errno set on failure
+ */
+int dirscan(int dirfd, const char *path, dirscan_fn fn, void *arg);
+
+/**
+ * Resolve whether an entry is a directory, falling back to fstatat
+ * when the filesystem does not fill d_type
+ */
+bool dirscan_is_dir(int dirfd, const char *name, unsigned char type);
+
+#endif
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "dirscan.h"
+#include "expand.h"
+
+/*
+ * Every path segment of a pattern (the part between slashes) is compiled
+ * once into tokens, then matched against names with a single backtrack
+ * point for the last '*', which keeps a match linear in the name length
+ * for typical patterns.
+ */
+enum token_kind { TOKEN_CHAR, TOKEN_ANY, TOKEN_STAR, TOKEN_CLASS };
+
+struct token {
+	enum token_kind kind;
+	unsigned char c;
+	uint32_t class[8]; // 256 bit set for TOKEN_CLASS
+};
+
+struct segment {
+	const char *text;
+	size_t len;
+	bool magic;
+	struct token *tokens;
+	int token_count;
+};
+
+/*
+ * One directory read with dirscan: names packed NUL separated in one
+ * buffer, kept in a hash table for the rest of the command line
+ */
+struct listing {
+	char *path;
+	char *names;
+	size_t names_len, names_cap;
+	size_t *offsets;
+	unsigned char *types;
+	int count, capacity;
+	struct listing *next; // hash chain
+};
+
+struct expand_cache {
+	struct listing **buckets;
+	unsigned int mask;
+	int count;
+};
+
+#define CACHE_BUCKETS_MIN 64
+
+struct expand_cache *expand_cache_new(void) {
+	struct expand_cache *cache = calloc(1, sizeof(*cache));
+	cache->buckets = calloc(CACHE_BUCKETS_MIN, sizeof(struct listing *));
+	cache->mask = CACHE_BUCKETS_MIN - 1;
+	return cache;
+}
+
+void expand_cache_free(struct expand_cache *cache) {
+	if (cache == NULL)
+		return;
+	for (unsigned int i = 0; i <= cache->mask; i++) {
+		struct listing *next;
+		for (struct listing *l = cache->buckets[i]; l; l = next) {
+			next = l->next;
+			free(l->path);
+			free(l->names);
+			free(l->offsets);
+			free(l->types);
+			free(l);
+		}
+	}
+	free(cache->buckets);
+	free(cache);
+}
+
+static unsigned int hash_path(const char *path) {
+	unsigned int h = 2166136261u; // FNV-1a
+	for (; *path; path++)
+		h = (h ^ (unsigned char)*path) * 16777619u;
+	return h;
+}
+
+static void cache_grow(struct expand_cache *cache) {
+	unsigned int size = (cache->mask + 1) * 2;
+	struct listing **buckets = calloc(size, sizeof(struct listing *));
+	for (unsigned int i = 0; i <= cache->mask; i++) {
+		struct listing *next;
+		for (struct listing *l = cache->buckets[i]; l; l = next) {
+			next = l->next;
+			unsigned int slot = hash_path(l->path) & (size - 1);
+			l->next = buckets[slot];
+			buckets[slot] = l;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->mask = size - 1;
+}
+
+static int collect_entry(const char *name, unsigned char type, void *arg) {
+	struct listing *l = arg;
+	size_t len = strlen(name) + 1;
+	if (l->count == l->capacity) {
+		l->capacity = l->capacity ? l->capacity * 2 : 256;
+		l->offsets = realloc(l->offsets, sizeof(size_t) * l->capacity);
+		l->types = realloc(l->types, l->capacity);
+	}
+	if (l->names_len + len > l->names_cap) {
+		while (l->names_len + len > l->names_cap)
+			l->names_cap = l->names_cap ? l->names_cap * 2 : 4096;
+		l->names = realloc(l->names, l->names_cap);
+	}
+	memcpy(l->names + l->names_len, name, len);
+	l->offsets[l->count] = l->names_len;
+	l->types[l->count++] = type;
+	l->names_len += len;
+	return 0;
+}
+
+/**
+ * Listing of a directory, read on first use; an unreadable directory
+ * gives an empty listing
+ * @param path directory, "" for the current one
+ */
+static struct listing *cache_get(struct expand_cache *cache,
+								 const char *path) {
+	unsigned int slot = hash_path(path) & cache->mask;
+	for (struct listing *l = cache->buckets[slot]; l; l = l->next) {
+		if (strcmp(l->path, path) == 0)
+			return l;
+	}
+
+	struct listing *l = calloc(1, sizeof(*l));
+	l->path = strdup(path);
+	if (dirscan(AT_FDCWD, path[0] ? path : ".", collect_entry, l) == -1)
+		l->count = 0;
+
+	if (++cache->count > (int)cache->mask + 1) {
+		cache_grow(cache);
+		slot = hash_path(path) & cache->mask;
+	}
+	l->next = cache->buckets[slot];
+	cache->buckets[slot] = l;
+	return l;
+}
+
+/**
+ * Compile "[...]" starting at p
+ * @return length consumed, 0 if there is no closing ']'
+ */
+static size_t compile_class(const char *p, size_t len, struct token *t) {
+	size_t i = 1;
+	bool negate = false;
+	memset(t->class, 0, sizeof(t->class));
+	t->kind = TOKEN_CLASS;
+	if (i < len && (p[i] == '!' || p[i] == '^')) {
+		negate = true;
+		i++;
+	}
+	size_t first = i;
+	for (; i < len && (p[i] != ']' || i == first); i++) {
+		unsigned char lo = p[i], hi = p[i];
+		if (i + 2 < len && p[i + 1] == '-' && p[i + 2] != ']') {
+			hi = p[i + 2];
+			i += 2;
+		}
+		for (unsigned int c = lo; c <= hi; c++)
+			t->class[c / 32] |= 1u << (c % 32);
+	}
+	if (i >= len)
+		return 0;
+	if (negate) {
+		for (int w = 0; w < 8; w++)
+			t->class[w] = ~t->class[w];
+	}
+	return i + 1;
+}
+
+static void compile_segment(struct segment *seg) {
+	seg->tokens = malloc(sizeof(struct token) * (seg->len + 1));
+	seg->token_count = 0;
+	for (size_t i = 0; i < seg->len;) {
+		struct token *t = &seg->tokens[seg->token_count++];
+		char c = seg->text[i];
+		if (c == '*') {
+			t->kind = TOKEN_STAR;
+			while (i < seg->len && seg->text[i] == '*')
+				i++; // ** is the same as *
+			continue;
+		}
+		if (c == '?') {
+			t->kind = TOKEN_ANY;
+			i++;
+			continue;
+		}
+		if (c == '[') {
+			size_t used = compile_class(seg->text + i, seg->len - i, t);
+			if (used > 0) {
+				i += used;
+				continue;
+			}
+		}
+		if (c == '\\' && i + 1 < seg->len)
+			c = seg->text[++i];
+		t->kind = TOKEN_CHAR;
+		t->c = c;
+		i++;
+	}
+}
+
+static bool token_matches(const struct token *t, unsigned char c) {
+	switch (t->kind) {
+	case TOKEN_CHAR:
+		return t->c == c;
+	case TOKEN_ANY:
+		return true;
+	case TOKEN_CLASS:
+		return t->class[c / 32] & (1u << (c % 32));
+	default:
+		return false;
+	}
+}
+
+static bool segment_matches(const struct segment *seg, const char *name) {
+	const struct token *t = seg->tokens;
+	int n = seg->token_count, ti = 0, star = -1;
+	const char *s = name, *star_s = NULL;
+
+	while (*s) {
+		if (ti < n && t[ti].kind == TOKEN_STAR) {
+			star = ti++;
+			star_s = s;
+		} else if (ti < n && token_matches(&t[ti], *s)) {
+			ti++;
+			s++;
+		} else if (star != -1) {
+			ti = star + 1;
+			s = ++star_s;
+		} else {
+			return false;
+		}
+	}
+	while (ti < n && t[ti].kind == TOKEN_STAR)
+		ti++;
+	return ti == n;
+}
+
+bool expand_has_magic(const char *word) {
+	for (const char *p = word; *p; p++) {
+		if (*p == '\\' && p[1])
+			p++;
+		else if (*p == '*' || *p == '?')
+			return true;
+		else if (*p == '[' && strchr(p + 1, ']') != NULL)
+			return true;
+	}
+	return false;
+}
+
+static void add_result(struct expand_result *result, const char *path) {
+	if (result->count == result->capacity) {
+		result->capacity = result->capacity ? result->capacity * 2 : 64;
+		result->paths =
+			realloc(result->paths, sizeof(char *) * result->capacity);
+	}
+	result->paths[result->count++] = strdup(path);
+}
+
+/**
+ * Match segments[i..] below path, which holds the part already matched
+ */
+static void expand_from(struct expand_cache *cache, struct segment *segments,
+						int count, int i, bool dirs_only, char *path,
+						size_t path_len, struct expand_result *result) {
+	struct stat st;
+	if (i == count) {
+		// whatever was literal since the last pattern still has to exist
+		if (lstat(path, &st) == 0 && (!dirs_only || S_ISDIR(st.st_mode)))
+			add_result(result, path);
+		return;
+	}
+
+	struct segment *seg = &segments[i];
+	size_t sep = path_len > 0 && path[path_len - 1] != '/';
+	if (path_len + sep + seg->len + 1 >= PATH_MAX)
+		return;
+
+	if (!seg->magic) {
+		size_t at = path_len + sep;
+		if (sep)
+			path[path_len] = '/';
+		for (size_t c = 0; c < seg->len; c++) {
+			if (seg->text[c] == '\\' && c + 1 < seg->len)
+				c++;
+			path[at++] = seg->text[c];
+		}
+		path[at] = 0;
+		expand_from(cache, segments, count, i + 1, dirs_only, path, at,
+					result);
+		path[path_len] = 0;
+		return;
+	}
+
+	struct listing *l = cache_get(cache, path);
+	bool last = i + 1 == count;
+	for (int e = 0; e < l->count; e++) {
+		const char *name = l->names + l->offsets[e];
+		if (name[0] == '.' && seg->text[0] != '.')
+			continue;
+		if (!segment_matches(seg, name))
+			continue;
+
+		size_t len = strlen(name);
+		if (path_len + sep + len + 1 >= PATH_MAX)
+			continue;
+		size_t at = path_len;
+		if (sep)
+			path[at++] = '/';
+		memcpy(path + at, name, len + 1);
+		if ((!last || dirs_only) &&
+			!dirscan_is_dir(AT_FDCWD, path, l->types[e]))
+			continue;
+		if (last)
+			add_result(result, path);
+		else
+			expand_from(cache, segments, count, i + 1, dirs_only, path,
+						at + len, result);
+	}
+	path[path_len] = 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int expand_glob(struct expand_cache *cache, const char *pattern,
+				struct expand_result *result) {
+	int first = result->count;
+	int count = 0, capacity = 8;
+	struct segment *segments = malloc(sizeof(struct segment) * capacity);
+	char path[PATH_MAX] = "";
+	size_t path_len = 0;
+
+	if (pattern[0] == '/') {
+		path[path_len++] = '/';
+		path[path_len] = 0;
+	}
+	for (const char *p = pattern; *p;) {
+		const char *end = strchr(p, '/');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+		if (len > 0) {
+			if (count == capacity)
+				segments = realloc(segments,
+								   sizeof(struct segment) * (capacity *= 2));
+			struct segment *seg = &segments[count++];
+			memset(seg, 0, sizeof(*seg));
+			seg->text = p;
+			seg->len = len;
+			for (size_t i = 0; i < len; i++) {
+				if (p[i] == '\\' && i + 1 < len)
+					i++;
+				else if (p[i] == '*' || p[i] == '?' ||
+						 (p[i] == '[' && memchr(p + i, ']', len - i)))
+					seg->magic = true;
+			}
+			if (seg->magic)
+				compile_segment(seg);
+		}
+		p += len;
+		if (*p == '/')
+			p++;
+	}
+
+	// "dir*/" only matches directories and keeps the slash
+	bool dirs_only = pattern[0] && pattern[strlen(pattern) - 1] == '/';
+	expand_from(cache, segments, count, 0, dirs_only, path, path_len,
+				result);
+
+	for (int i = 0; i < count; i++)
+		free(segments[i].tokens);
+	free(segments);
+
+	int added = result->count - first;
+	qsort(result->paths + first, added, sizeof(char *), compare_paths);
+	if (dirs_only) {
+		for (int i = first; i < result->count; i++) {
+			size_t len = strlen(result->paths[i]);
+			result->paths[i] = realloc(result->paths[i], len + 2);
+			memcpy(result->paths[i] + len, "/", 2);
+		}
+	}
+	return added;
+}
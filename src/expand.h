@@ -0,0 +1,38 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+
+/*
+ * Directory listings read while expanding one command line, so a directory
+ * named by several patterns is only read once
+ */
+struct expand_cache;
+
+struct expand_result {
+	char **paths;
+	int count, capacity;
+};
+
+struct expand_cache *expand_cache_new(void);
+void expand_cache_free(struct expand_cache *cache);
+
+/**
+ * Whether a word has any of *, ? or [...] in it
+ */
+bool expand_has_magic(const char *word);
+
+/**
+ * Expand a glob pattern. Each directory is read once with dirscan and its
+ * entries are matched against the compiled pattern; names starting with a
+ * dot only match a pattern that starts with one too
+ * @param  cache   listings of this command line
+ * @param  pattern pattern, e.g. "src/*.c"
+ * @param  result  matching paths are added here in sorted order, to be
+ *                 freed by the caller
+ * @return         number of paths added
+ */
+int expand_glob(struct expand_cache *cache, const char *pattern,
+				struct expand_result *result);
+
+#endif
@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "launch.h"
+#include "shell.h"
+
+// from linux/mempolicy.h and linux/ioprio.h, so libnuma isn't needed
+#define MPOL_PREFERRED 1
+#define MPOL_BIND 2
+#define MPOL_INTERLEAVE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+static const struct {
+	const char *name;
+	int resource;
+} rlimit_names[] = {
+	{ "as", RLIMIT_AS },		 { "core", RLIMIT_CORE },
+	{ "cpu", RLIMIT_CPU },		 { "data", RLIMIT_DATA },
+	{ "fsize", RLIMIT_FSIZE },	 { "memlock", RLIMIT_MEMLOCK },
+	{ "nofile", RLIMIT_NOFILE }, { "nproc", RLIMIT_NPROC },
+	{ "stack", RLIMIT_STACK },	 { NULL, 0 },
+};
+
+static void usage(void) {
+	fprintf(
+		stderr,
+		"Usage: run [options] [--] <command>\n"
+		"  --cpus LIST            pin to cpus, e.g. 0-3,8\n"
+		"  --spread LIST          pin stage n of the pipeline to the n-th cpu\n"
+		"  --membind NODES        allocate memory only on these NUMA nodes\n"
+		"  --interleave NODES     interleave memory over these NUMA nodes\n"
+		"  --preferred NODE       prefer memory from this NUMA node\n"
+		"  --nice N               niceness\n"
+		"  --ionice CLASS[:LEVEL] io priority, CLASS is rt, be or idle\n"
+		"  --rlimit NAME=VALUE    set a resource limit (as, core, cpu, data,\n"
+		"                         fsize, memlock, nofile, nproc, stack)\n"
+		"Given before the first stage they apply to the whole pipeline.\n");
+}
+
+/**
+ * Parse a list like "0-3,8,10-11"
+ * @return number of entries, -1 if malformed or any is max or above
+ */
+static int parse_list(const char *list, int *out, int max) {
+	int count = 0;
+	const char *p = list;
+	while (*p) {
+		char *end;
+		long first = strtol(p, &end, 10), last;
+		if (end == p || first < 0)
+			return -1;
+		last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first)
+				return -1;
+		}
+		for (long i = first; i <= last; i++) {
+			if (i >= max || count == max)
+				return -1;
+			out[count++] = i;
+		}
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		p = end;
+	}
+	return count > 0 ? count : -1;
+}
+
+static int parse_nodes(const char *list, struct launch_options *options,
+					   int mode) {
+	static int nodes[LAUNCH_NODES_MAX]; // only parsed on the main thread
+	int count = parse_list(list, nodes, LAUNCH_NODES_MAX);
+	if (count == -1 || (mode == MPOL_PREFERRED && count != 1))
+		return -1;
+	memset(options->nodes, 0, sizeof(options->nodes));
+	for (int i = 0; i < count; i++)
+		options->nodes[nodes[i] / (8 * sizeof(unsigned long))] |=
+			1UL << (nodes[i] % (8 * sizeof(unsigned long)));
+	options->mempolicy = mode;
+	return 0;
+}
+
+static int parse_ioprio(const char *value, struct launch_options *options) {
+	int class, level = 4;
+	const char *colon = strchr(value, ':');
+	size_t len = colon ? (size_t)(colon - value) : strlen(value);
+
+	if (len == 2 && strncmp(value, "rt", 2) == 0)
+		class = 1;
+	else if (len == 2 && strncmp(value, "be", 2) == 0)
+		class = 2;
+	else if (len == 4 && strncmp(value, "idle", 4) == 0)
+		class = 3, level = 0;
+	else
+		return -1;
+	if (colon != NULL) {
+		char *end;
+		level = strtol(colon + 1, &end, 10);
+		if (*end || end == colon + 1 || level < 0 || level > 7)
+			return -1;
+	}
+	options->ioprio = class << IOPRIO_CLASS_SHIFT | level;
+	return 0;
+}
+
+static int parse_rlimit(const char *value, struct launch_options *options) {
+	const char *eq = strchr(value, '=');
+	if (eq == NULL || options->rlimit_count == LAUNCH_RLIMITS_MAX)
+		return -1;
+
+	int i = 0;
+	while (rlimit_names[i].name != NULL &&
+		   (strlen(rlimit_names[i].name) != (size_t)(eq - value) ||
+			strncmp(rlimit_names[i].name, value, eq - value) != 0))
+		i++;
+	if (rlimit_names[i].name == NULL)
+		return -1;
+
+	rlim_t limit = RLIM_INFINITY;
+	if (strcmp(eq + 1, "unlimited") != 0) {
+		char *end;
+		int shift = 0;
+		errno = 0;
+		unsigned long long n = strtoull(eq + 1, &end, 10);
+		if (end == eq + 1 || errno == ERANGE || eq[1] == '-')
+			return -1;
+		switch (*end) {
+		case 'g':
+		case 'G':
+			shift += 10;
+			// fall through
+		case 'm':
+		case 'M':
+			shift += 10;
+			// fall through
+		case 'k':
+		case 'K':
+			shift += 10;
+			end++;
+			break;
+		}
+		// anything from RLIM_INFINITY up would wrap or mean unlimited
+		if (*end || n >= (RLIM_INFINITY >> shift))
+			return -1;
+		limit = (rlim_t)n << shift;
+	}
+
+	// like ulimit, the soft and the hard limit both
+	options->rlimits[options->rlimit_count].resource = rlimit_names[i].resource;
+	options->rlimits[options->rlimit_count].limit.rlim_cur = limit;
+	options->rlimits[options->rlimit_count].limit.rlim_max = limit;
+	options->rlimit_count++;
+	return 0;
+}
+
+struct launch_options *launch_parse(struct command_t *command) {
+	struct launch_options *options = calloc(1, sizeof(*options));
+	options->mempolicy = -1;
+	options->ioprio = -1;
+
+	int i = 1;
+	char **args = command->args;
+	for (; args[i] != NULL && strncmp(args[i], "--", 2) == 0; i++) {
+		const char *option = args[i];
+		const char *value = args[i + 1];
+		int status = 0;
+		if (strcmp(option, "--") == 0) {
+			i++;
+			break;
+		}
+		if (value == NULL) {
+			status = -1;
+		} else if (strcmp(option, "--cpus") == 0 ||
+				   strcmp(option, "--spread") == 0) {
+			options->cpu_count =
+				parse_list(value, options->cpu_list, CPU_SETSIZE);
+			status = options->cpu_count == -1 ? -1 : 0;
+			CPU_ZERO(&options->cpus);
+			for (int c = 0; c < options->cpu_count; c++)
+				CPU_SET(options->cpu_list[c], &options->cpus);
+			options->has_cpus = true;
+			options->spread = option[2] == 's';
+		} else if (strcmp(option, "--membind") == 0) {
+			status = parse_nodes(value, options, MPOL_BIND);
+		} else if (strcmp(option, "--interleave") == 0) {
+			status = parse_nodes(value, options, MPOL_INTERLEAVE);
+		} else if (strcmp(option, "--preferred") == 0) {
+			status = parse_nodes(value, options, MPOL_PREFERRED);
+		} else if (strcmp(option, "--nice") == 0) {
+			char *end;
+			options->nice = strtol(value, &end, 10);
+			options->has_nice = true;
+			status = *end || end == value ? -1 : 0;
+		} else if (strcmp(option, "--ionice") == 0) {
+			status = parse_ioprio(value, options);
+		} else if (strcmp(option, "--rlimit") == 0) {
+			status = parse_rlimit(value, options);
+		} else {
+			fprintf(stderr, "-%s: run: %s: unknown option\n", sysname,
+					option);
+			usage();
+			free(options);
+			return NULL;
+		}
+		if (status == -1) {
+			fprintf(stderr, "-%s: run: %s: invalid value `%s'\n", sysname,
+					option, value ? value : "");
+			free(options);
+			return NULL;
+		}
+		i++; // the value
+	}
+
+	if (args[i] == NULL) {
+		usage();
+		free(options);
+		return NULL;
+	}
+	while (i-- > 0)
+		shift_command(command);
+	return options;
+}
+
+static int launch_error(const char *what) {
+	fprintf(stderr, "-%s: run: %s: %s\n", sysname, what, strerror(errno));
+	return -1;
+}
+
+int launch_apply(const struct launch_options *options, int stage) {
+	if (options->has_cpus) {
+		cpu_set_t set = options->cpus;
+		if (options->spread) {
+			CPU_ZERO(&set);
+			CPU_SET(options->cpu_list[stage % options->cpu_count], &set);
+		}
+		if (sched_setaffinity(0, sizeof(set), &set) == -1)
+			return launch_error("sched_setaffinity");
+	}
+	// maxnode counts one past the last bit the kernel reads
+	if (options->mempolicy != -1 &&
+		syscall(SYS_set_mempolicy, options->mempolicy, options->nodes,
+				LAUNCH_NODES_MAX + 1) == -1)
+		return launch_error("set_mempolicy");
+	if (options->has_nice &&
+		setpriority(PRIO_PROCESS, 0, options->nice) == -1)
+		return launch_error("setpriority");
+	if (options->ioprio != -1 &&
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, options->ioprio) == -1)
+		return launch_error("ioprio_set");
+	for (int i = 0; i < options->rlimit_count; i++) {
+		if (setrlimit(options->rlimits[i].resource,
+					  &options->rlimits[i].limit) == -1)
+			return launch_error("setrlimit");
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+struct command_t;
+
+#define LAUNCH_RLIMITS_MAX 16
+#define LAUNCH_NODES_MAX 1024
+
+/*
+ * Placement and limits set by the run prefix, applied in the child right
+ * before it execs
+ */
+struct launch_options {
+	bool has_cpus;
+	bool spread; // one cpu of the set per pipeline stage, round robin
+	cpu_set_t cpus;
+	int cpu_list[CPU_SETSIZE]; // cpus in the order given, for spread
+	int cpu_count;
+
+	int mempolicy; // -1 to inherit
+	unsigned long nodes[LAUNCH_NODES_MAX / (8 * sizeof(unsigned long))];
+
+	bool has_nice;
+	int nice;
+	int ioprio; // -1 to inherit
+
+	int rlimit_count;
+	struct {
+		int resource;
+		struct rlimit limit;
+	} rlimits[LAUNCH_RLIMITS_MAX];
+};
+
+/**
+ * Take a leading "run [options] --" off a command
+ * @param  command stage whose name is "run"; on success its name is the
+ *                 command to launch
+ * @return         the options, NULL after printing an error
+ */
+struct launch_options *launch_parse(struct command_t *command);
+
+/**
+ * Apply the options to the calling (child) process
+ * @param  options options from launch_parse
+ * @param  stage   index of the stage in its pipeline, for spread
+ * @return         0, -1 after printing an error
+ */
+int launch_apply(const struct launch_options *options, int stage);
+
+#endif
@@ -0,0 +1,58 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prompt.h"
+#include "serve.h"
+#include "shell.h"
+#include "timing.h"
+#include "trace.h"
+
+int main(int argc, char **argv) {
+	trace_init();
+	// builtins writing to a closed pipe on a thread must get EPIPE rather
+	// than take the whole shell down; children get the default back
+	signal(SIGPIPE, SIG_IGN);
+
+	if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+		if (argc != 3) {
+			fprintf(stderr, "Usage: %s --serve <socket path>\n", argv[0]);
+			return 2;
+		}
+		return serve_main(argv[2]);
+	}
+
+	while (1) {
+		struct command_t *command = malloc(sizeof(struct command_t));
+
+		// set all bytes to 0
+		memset(command, 0, sizeof(struct command_t));
+
+		// no syscalls at all while no background job is running
+		if (background_job_count() > 0)
+			prompt_set_jobs(reap_background_jobs());
+
+		int code;
+		code = prompt(command);
+		if (code == EXIT) {
+			free_command(command);
+			break;
+		}
+
+		long long start = timing_now_ns();
+		last_status = 0;
+		code = process_command(command);
+		prompt_set_status(last_status, timing_now_ns() - start);
+		prompt_set_jobs(background_job_count());
+		if (code == EXIT) {
+			free_command(command);
+			break;
+		}
+
+		free_command(command);
+	}
+
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copy.h"
+#include "dirscan.h"
+#include "move.h"
+
+#define MOVE_THREADS_MAX 8
+
+static int rename_noreplace(const char *from, const char *to) {
+	if (renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE) == 0)
+		return 0;
+	if (errno != EINVAL && errno != ENOSYS)
+		return -1;
+	// the filesystem doesn't know the flag, check first as the best we can
+	struct stat st;
+	if (lstat(to, &st) == 0) {
+		errno = EEXIST;
+		return -1;
+	}
+	return rename(from, to);
+}
+
+static int move_across(const char *from, const char *to);
+
+/**
+ * Give a copy the owner and group of the original, as mv does. Without the
+ * right to give it away, the group is still kept if we are in it, and
+ * anything else is left to the user moving it: this never fails the move.
+ * @param fd   copy to change, or -1 to change path without following it
+ */
+static void copy_owner(int fd, const char *path, const struct stat *st) {
+	int flags = fd == -1 ? AT_SYMLINK_NOFOLLOW : AT_EMPTY_PATH;
+	const char *name = fd == -1 ? path : "";
+	int dirfd = fd == -1 ? AT_FDCWD : fd;
+	if (fchownat(dirfd, name, st->st_uid, st->st_gid, flags) == -1)
+		fchownat(dirfd, name, -1, st->st_gid, flags);
+}
+
+/**
+ * Set the access and modification times of a copy that isn't open, without
+ * following a symlink
+ */
+static int copy_times(const char *path, const struct stat *st) {
+	const struct timespec times[2] = { st->st_atim, st->st_mtim };
+	return utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+}
+
+static int move_file_across(const char *from, const struct stat *st,
+							const char *to) {
+	int in_fd = open(from, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (in_fd == -1)
+		return -1;
+	int out_fd = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (out_fd == -1) {
+		close(in_fd);
+		return -1;
+	}
+
+	const struct timespec times[2] = { st->st_atim, st->st_mtim };
+	int status = copy_fd(in_fd, out_fd) == -1 ? -1 : 0;
+	if (status == 0)
+		copy_owner(out_fd, to, st); // before fchmod, it drops setuid bits
+	if (status == 0)
+		status = fchmod(out_fd, st->st_mode & 07777);
+	if (status == 0)
+		status = futimens(out_fd, times);
+	// the copy has to be on disk before the only other copy goes away
+	if (status == 0)
+		status = fsync(out_fd);
+	if (close(out_fd) == -1)
+		status = -1;
+
+	int saved_errno = errno;
+	close(in_fd);
+	if (status == -1) {
+		unlink(to);
+		errno = saved_errno;
+		return -1;
+	}
+	return unlink(from);
+}
+
+static int move_link_across(const char *from, const struct stat *st,
+							const char *to) {
+	char *target = malloc(st->st_size + 1);
+	if (target == NULL)
+		return -1;
+	ssize_t len = readlink(from, target, st->st_size + 1);
+	if (len == -1 || len > st->st_size) {
+		free(target);
+		if (len != -1)
+			errno = EAGAIN; // changed under us
+		return -1;
+	}
+	target[len] = 0;
+	int status = symlink(target, to);
+	free(target);
+	if (status == -1)
+		return -1;
+	copy_owner(-1, to, st);
+	// not every filesystem has times on symlinks, the link itself moved
+	copy_times(to, st);
+	return unlink(from);
+}
+
+struct names {
+	char **names;
+	int count, capacity;
+};
+
+static int collect_name(const char *name, unsigned char type, void *arg) {
+	(void)type;
+	struct names *list = arg;
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->names =
+			realloc(list->names, sizeof(char *) * list->capacity);
+	}
+	list->names[list->count++] = strdup(name);
+	return 0;
+}
+
+static int move_dir_across(const char *from, const struct stat *st,
+						   const char *to) {
+	struct names list = { 0 };
+	int status = 0;
+
+	if (mkdir(to, 0700) == -1)
+		return -1;
+	// read the whole listing before entries start disappearing from it
+	if (dirscan(AT_FDCWD, from, collect_name, &list) == -1)
+		status = -1;
+
+	for (int i = 0; i < list.count; i++) {
+		char src[PATH_MAX], dst[PATH_MAX];
+		if (status == 0) {
+			snprintf(src, sizeof(src), "%s/%s", from, list.names[i]);
+			snprintf(dst, sizeof(dst), "%s/%s", to, list.names[i]);
+			status = move_across(src, dst);
+		}
+		free(list.names[i]);
+	}
+	free(list.names);
+
+	if (status == 0)
+		copy_owner(-1, to, st);
+	if (status == 0)
+		status = chmod(to, st->st_mode & 07777);
+	// last, moving the entries in changed the times
+	if (status == 0)
+		status = copy_times(to, st);
+	// a failed directory is left half moved, with nothing lost: every entry
+	// is either still in the source or fully in the destination
+	return status == 0 ? rmdir(from) : -1;
+}
+
+static int move_across(const char *from, const char *to) {
+	struct stat st;
+	if (lstat(from, &st) == -1)
+		return -1;
+	if (S_ISREG(st.st_mode))
+		return move_file_across(from, &st, to);
+	if (S_ISLNK(st.st_mode))
+		return move_link_across(from, &st, to);
+	if (S_ISDIR(st.st_mode))
+		return move_dir_across(from, &st, to);
+	if (mknod(to, st.st_mode, st.st_rdev) == -1)
+		return -1;
+	copy_owner(-1, to, &st);
+	if (chmod(to, st.st_mode & 07777) == -1 || copy_times(to, &st) == -1) {
+		int saved_errno = errno;
+		unlink(to);
+		errno = saved_errno;
+		return -1;
+	}
+	return unlink(from);
+}
+
+int move_path(const char *from, const char *to) {
+	if (rename_noreplace(from, to) == 0)
+		return 0;
+	if (errno != EXDEV)
+		return -1;
+	return move_across(from, to);
+}
+
+struct move_pool {
+	struct move_job *jobs;
+	int count;
+	atomic_int next;
+};
+
+static void *move_worker(void *arg) {
+	struct move_pool *pool = arg;
+	int i;
+	while ((i = atomic_fetch_add_explicit(&pool->next, 1,
+										  memory_order_relaxed)) <
+		   pool->count) {
+		struct move_job *job = &pool->jobs[i];
+		job->error = move_path(job->from, job->to) == 0 ? 0 : errno;
+	}
+	return NULL;
+}
+
+int move_batch(struct move_job *jobs, int count) {
+	struct move_pool pool = { jobs, count, 0 };
+	pthread_t threads[MOVE_THREADS_MAX];
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int thread_count = count < MOVE_THREADS_MAX ? count : MOVE_THREADS_MAX;
+	if (cpus > 0 && cpus < thread_count)
+		thread_count = cpus;
+
+	// the calling thread is one of the workers
+	int started = 0;
+	for (; started < thread_count - 1; started++) {
+		if (pthread_create(&threads[started], NULL, move_worker, &pool) != 0)
+			break;
+	}
+	move_worker(&pool);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	int failed = 0;
+	for (int i = 0; i < count; i++)
+		failed += jobs[i].error != 0;
+	return failed;
+}
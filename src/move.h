@@ -0,0 +1,32 @@
+#ifndef MOVE_H
+#define MOVE_H
+
+#include <limits.h>
+
+/**
+ * Move a file, symlink or directory. Never replaces an existing
+ * destination (renameat2 RENAME_NOREPLACE); across filesystems the data is
+ * copied with copy_file_range, fsync'ed and only then is the source
+ * unlinked. Copies keep the mode, access and modification times, and the
+ * owner and group where we are allowed to set them, like mv.
+ * @param  from source path
+ * @param  to   destination path, must not exist
+ * @return      0, -1 with errno set on failure
+ */
+int move_path(const char *from, const char *to);
+
+struct move_job {
+	const char *from;
+	char to[PATH_MAX];
+	int error; // errno of the failed move, 0 on success
+};
+
+/**
+ * Run a batch of moves on a bounded pool of threads
+ * @param  jobs  moves to make, error is filled in for each
+ * @param  count number of jobs
+ * @return       number of failed moves
+ */
+int move_batch(struct move_job *jobs, int count);
+
+#endif
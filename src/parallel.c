@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "parallel.h"
+#include "shell.h"
+
+#define PARALLEL_FAILED_MAX 100
+#define READ_CHUNK 65536
+#define REAP_POLL_MS 10 // without pidfds, how often exits are checked
+
+struct job {
+	pid_t pid;
+	int pidfd; // readable once the child exited, -1 if reaped or none
+	int pipe_fd; // output read end with keep_order, -1 otherwise
+	char *buf; // buffered output
+	size_t len, cap;
+	int status;
+	bool exited; // reaped
+	bool done;
+};
+
+/**
+ * Substitute the input for every "{}" of every word, or add it as the last
+ * word when there is no "{}" at all
+ */
+static char **expand_template(char **template, const char *input,
+							  int *arg_count) {
+	int count = 0;
+	bool used = false;
+	while (template[count] != NULL)
+		count++;
+	char **args = calloc(count + 2, sizeof(char *));
+	size_t input_len = strlen(input);
+
+	for (int i = 0; i < count; i++) {
+		const char *word = template[i];
+		size_t len = strlen(word) + 1;
+		for (const char *p = strstr(word, "{}"); p; p = strstr(p + 2, "{}"))
+			len += input_len;
+		char *out = malloc(len);
+		char *o = out;
+		for (const char *p = word; *p;) {
+			if (p[0] == '{' && p[1] == '}') {
+				memcpy(o, input, input_len);
+				o += input_len;
+				p += 2;
+				used = true;
+			} else {
+				*o++ = *p++;
+			}
+		}
+		*o = 0;
+		args[i] = out;
+	}
+	if (!used)
+		args[count++] = strdup(input);
+	*arg_count = count;
+	return args;
+}
+
+static int start_job(struct job *job, char **template, const char *input,
+					 int in_fd, int out_fd, bool keep_order) {
+	int pipefd[2] = { -1, -1 };
+	if (keep_order && pipe2(pipefd, O_CLOEXEC) == -1)
+		return -1;
+
+	int arg_count;
+	char **args = expand_template(template, input, &arg_count);
+	fflush(stdout); // don't let the child inherit pending output
+	pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGPIPE, SIG_DFL); // ignored by the shell itself
+		if (in_fd != STDIN_FILENO)
+			dup2(in_fd, STDIN_FILENO);
+		dup2(keep_order ? pipefd[1] : out_fd, STDOUT_FILENO);
+		close_range(STDERR_FILENO + 1, ~0U, 0);
+
+		const struct builtin *builtin = builtin_for(args);
+		if (builtin != NULL) {
+			int status =
+				builtin_run(builtin, args, STDIN_FILENO, STDOUT_FILENO);
+			fflush(stdout);
+			_exit(status);
+		}
+		struct command_t command = { 0 };
+		command.name = args[0];
+		command.args = args;
+		command.arg_count = arg_count;
+		exec_command(&command);
+	}
+
+	for (int i = 0; i < arg_count; i++)
+		free(args[i]);
+	free(args);
+	if (keep_order)
+		close(pipefd[1]);
+	if (pid == -1) {
+		if (keep_order)
+			close(pipefd[0]);
+		return -1;
+	}
+
+	memset(job, 0, sizeof(*job));
+	job->pid = pid;
+	job->pipe_fd = keep_order ? pipefd[0] : -1;
+	// without pidfds (old kernel) the job is reaped by polling instead
+	job->pidfd = pidfd_open(pid, 0);
+	return 0;
+}
+
+static void read_output(struct job *job) {
+	if (job->cap - job->len < READ_CHUNK) {
+		job->cap = job->cap ? job->cap * 2 : READ_CHUNK * 2;
+		job->buf = realloc(job->buf, job->cap);
+	}
+	ssize_t n = read(job->pipe_fd, job->buf + job->len, job->cap - job->len);
+	if (n == -1 && errno == EINTR)
+		return;
+	if (n <= 0) {
+		close(job->pipe_fd);
+		job->pipe_fd = -1;
+		return;
+	}
+	job->len += n;
+}
+
+static void write_output(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return; // nobody is reading any more
+		buf += n;
+		len -= n;
+	}
+}
+
+int parallel_run(char **template, char **inputs, int count, int max_jobs,
+				 bool keep_order, int in_fd, int out_fd) {
+	struct job *jobs = calloc(count, sizeof(struct job));
+	int *active = malloc(sizeof(int) * max_jobs); // indices of running jobs
+	struct pollfd *fds = malloc(sizeof(struct pollfd) * max_jobs * 2);
+	int *fd_job = malloc(sizeof(int) * max_jobs * 2);
+	int next = 0, running = 0, flushed = 0, failed = 0;
+
+	while (next < count || running > 0) {
+		while (running < max_jobs && next < count) {
+			struct job *job = &jobs[next];
+			if (start_job(job, template, inputs[next], in_fd, out_fd,
+						  keep_order) == -1) {
+				fprintf(stderr, "-%s: parallel: %s: %s\n", sysname,
+						inputs[next], strerror(errno));
+				job->status = W_EXITCODE(127, 0);
+				job->pidfd = job->pipe_fd = -1;
+				job->exited = job->done = true;
+				failed++;
+			} else {
+				active[running++] = next;
+			}
+			next++;
+		}
+
+		int nfds = 0;
+		bool unwatched = false; // a job without a pidfd is still running
+		for (int i = 0; i < running; i++) {
+			struct job *job = &jobs[active[i]];
+			if (job->pidfd == -1 && !job->exited)
+				unwatched = true;
+			if (job->pidfd != -1) {
+				fds[nfds] = (struct pollfd){ job->pidfd, POLLIN, 0 };
+				fd_job[nfds++] = active[i];
+			}
+			if (job->pipe_fd != -1) {
+				fds[nfds] = (struct pollfd){ job->pipe_fd, POLLIN, 0 };
+				fd_job[nfds++] = active[i];
+			}
+		}
+		// never block in waitpid: a -k job could be stuck writing to its
+		// full pipe, so keep reading while checking for exits
+		if ((nfds > 0 || unwatched) &&
+			poll(fds, nfds, unwatched ? REAP_POLL_MS : -1) == -1 &&
+			errno != EINTR)
+			break;
+
+		for (int i = 0; i < nfds; i++) {
+			struct job *job = &jobs[fd_job[i]];
+			if (fds[i].revents == 0)
+				continue;
+			if (fds[i].fd == job->pipe_fd) {
+				read_output(job);
+			} else {
+				waitpid(job->pid, &job->status, 0);
+				close(job->pidfd);
+				job->pidfd = -1;
+				job->exited = true;
+			}
+		}
+		for (int i = 0; i < running && unwatched; i++) {
+			struct job *job = &jobs[active[i]];
+			if (job->pidfd == -1 && !job->exited &&
+				waitpid(job->pid, &job->status, WNOHANG) == job->pid)
+				job->exited = true;
+		}
+
+		// a job is finished once it exited and its output is drained
+		for (int i = 0; i < running;) {
+			struct job *job = &jobs[active[i]];
+			if (!job->exited || job->pipe_fd != -1) {
+				i++;
+				continue;
+			}
+			job->done = true;
+			if (!WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0)
+				failed++;
+			active[i] = active[--running];
+		}
+
+		for (; flushed < next && jobs[flushed].done; flushed++) {
+			write_output(out_fd, jobs[flushed].buf, jobs[flushed].len);
+			free(jobs[flushed].buf);
+		}
+	}
+
+	free(fd_job);
+	free(fds);
+	free(active);
+	free(jobs);
+	return failed < PARALLEL_FAILED_MAX ? failed : PARALLEL_FAILED_MAX;
+}
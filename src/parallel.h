@@ -0,0 +1,22 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+/**
+ * Run a command template once per input with at most max_jobs children in
+ * flight. Every "{}" in the template is replaced by the input, or the input
+ * is appended when the template has none
+ * @param  template   NULL terminated command and arguments
+ * @param  inputs     one entry per job
+ * @param  count      number of inputs
+ * @param  max_jobs   children running at once
+ * @param  keep_order buffer each job's output and write it in input order
+ * @param  in_fd      stdin for the jobs
+ * @param  out_fd     where the jobs' output goes
+ * @return            number of jobs that failed, at most 100
+ */
+int parallel_run(char **template, char **inputs, int count, int max_jobs,
+				 bool keep_order, int in_fd, int out_fd);
+
+#endif
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dirscan.h"
+#include "pathcache.h"
+
+#define PATH_CACHE_BUCKETS 4096
+
+struct path_entry {
+	char *name;
+	char *full; // directory/name
+	struct path_entry *next; // hash chain
+};
+
+struct cached_dir {
+	char *name;
+	struct timespec mtime;
+	bool present;
+};
+
+static struct path_entry *buckets[PATH_CACHE_BUCKETS];
+static char *cached_path; // PATH value the index was built from
+static struct cached_dir *cached_dirs;
+static int cached_dir_count;
+
+static unsigned int hash_name(const char *name) {
+	unsigned int hash = 2166136261u; // FNV-1a
+	for (; *name; name++)
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+	return hash % PATH_CACHE_BUCKETS;
+}
+
+static void path_cache_clear(void) {
+	for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+		while (buckets[i] != NULL) {
+			struct path_entry *e = buckets[i];
+			buckets[i] = e->next;
+			free(e->name);
+			free(e->full);
+			free(e);
+		}
+	}
+	for (int i = 0; i < cached_dir_count; i++)
+		free(cached_dirs[i].name);
+	free(cached_dirs);
+	free(cached_path);
+	cached_dirs = NULL;
+	cached_dir_count = 0;
+	cached_path = NULL;
+}
+
+/**
+ * Whether PATH or the mtime of one of its directories changed since the
+ * index was built
+ */
+static bool path_cache_stale(const char *path) {
+	if (cached_path == NULL || strcmp(cached_path, path) != 0)
+		return true;
+	for (int i = 0; i < cached_dir_count; i++) {
+		struct stat st;
+		bool present = stat(cached_dirs[i].name, &st) == 0;
+		if (present != cached_dirs[i].present)
+			return true;
+		if (present && (st.st_mtim.tv_sec != cached_dirs[i].mtime.tv_sec ||
+						st.st_mtim.tv_nsec != cached_dirs[i].mtime.tv_nsec))
+			return true;
+	}
+	return false;
+}
+
+static int index_entry(const char *name, unsigned char type, void *arg) {
+	const char *dir = arg;
+	(void)type; // exec_command takes any entry, like access(F_OK)
+	unsigned int slot = hash_name(name);
+	for (struct path_entry *e = buckets[slot]; e != NULL; e = e->next) {
+		if (strcmp(e->name, name) == 0)
+			return 0; // an earlier directory has it
+	}
+	struct path_entry *e = malloc(sizeof(*e));
+	e->name = strdup(name);
+	if (asprintf(&e->full, "%s/%s", dir, name) == -1) {
+		free(e->name);
+		free(e);
+		return 0;
+	}
+	e->next = buckets[slot];
+	buckets[slot] = e;
+	return 0;
+}
+
+void path_cache_refresh(const char *path) {
+	if (path == NULL || !path_cache_stale(path))
+		return;
+	path_cache_clear();
+
+	char *pathcpy = strdup(path);
+	char *save = NULL;
+	for (char *dir = strtok_r(pathcpy, ":", &save); dir;
+		 dir = strtok_r(NULL, ":", &save)) {
+		if (dir[0] != '/') {
+			// depends on the cwd of the lookup, leave every lookup to
+			// exec_command, and stay empty until PATH changes
+			path_cache_clear();
+			cached_path = strdup(path);
+			free(pathcpy);
+			return;
+		}
+		cached_dirs = realloc(cached_dirs, sizeof(struct cached_dir) *
+											   (cached_dir_count + 1));
+		struct cached_dir *cd = &cached_dirs[cached_dir_count++];
+		struct stat st;
+		cd->name = strdup(dir);
+		cd->present = stat(dir, &st) == 0;
+		if (!cd->present)
+			continue;
+		cd->mtime = st.st_mtim;
+		dirscan(AT_FDCWD, dir, index_entry, dir);
+	}
+	free(pathcpy);
+	cached_path = strdup(path);
+}
+
+const char *path_cache_lookup(const char *path, const char *name) {
+	if (cached_path == NULL || path == NULL || strcmp(cached_path, path) != 0)
+		return NULL;
+	for (struct path_entry *e = buckets[hash_name(name)]; e != NULL;
+		 e = e->next) {
+		if (strcmp(e->name, name) == 0)
+			return e->full;
+	}
+	return NULL;
+}
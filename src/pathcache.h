@@ -0,0 +1,21 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+/**
+ * Index the directories of path: every name maps to the first directory
+ * holding it, as the PATH lookup of exec_command finds it. Nothing is read
+ * again while path and the mtimes of its directories are unchanged, which
+ * costs one stat per directory. Meant for a long-lived parent whose forked
+ * children do the lookups, like the --serve loop.
+ * @param path value of PATH
+ */
+void path_cache_refresh(const char *path);
+
+/**
+ * Look a command name up in the index, without checking it is current
+ * @return full path to exec, NULL when the index is for another PATH, was
+ *         never built, or has no such name
+ */
+const char *path_cache_lookup(const char *path, const char *name);
+
+#endif
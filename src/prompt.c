@@ -0,0 +1,190 @@
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "prompt.h"
+
+#define PROMPT_DEFAULT_FORMAT "\\u@\\h:\\w \\s$ "
+#define PROMPT_MAX 4096
+
+extern const char *sysname;
+
+/*
+ * The format is compiled into a list of segments on the first render after
+ * an invalidation: literal text with every static escape already expanded,
+ * and the dynamic escapes which are filled in from memory on every render.
+ */
+enum segment_kind {
+	SEG_TEXT,
+	SEG_STATUS,
+	SEG_DURATION,
+	SEG_JOBS,
+};
+
+struct segment {
+	enum segment_kind kind;
+	size_t start, len; // slice of static_text for SEG_TEXT
+};
+
+static bool cache_valid;
+static char static_text[PROMPT_MAX];
+static size_t static_len;
+static struct segment segments[64];
+static int segment_count;
+
+static int prompt_status;
+static long long last_duration_ns;
+static int job_count;
+
+void prompt_invalidate(void) {
+	cache_valid = false;
+}
+
+void prompt_set_status(int status, long long duration_ns) {
+	prompt_status = status;
+	last_duration_ns = duration_ns;
+}
+
+void prompt_set_jobs(int jobs) {
+	job_count = jobs;
+}
+
+static void append_static(const char *s, size_t len) {
+	if (static_len + len >= sizeof(static_text))
+		len = sizeof(static_text) - static_len - 1;
+	struct segment *last =
+		segment_count ? &segments[segment_count - 1] : NULL;
+	if (last == NULL || last->kind != SEG_TEXT) {
+		if (segment_count == (int)(sizeof(segments) / sizeof(segments[0])))
+			return;
+		last = &segments[segment_count++];
+		*last = (struct segment){ SEG_TEXT, static_len, 0 };
+	}
+	memcpy(static_text + static_len, s, len);
+	static_len += len;
+	last->len += len;
+}
+
+static void append_dynamic(enum segment_kind kind) {
+	if (segment_count == (int)(sizeof(segments) / sizeof(segments[0])))
+		return;
+	segments[segment_count++] = (struct segment){ kind, 0, 0 };
+}
+
+static void compile_format(void) {
+	const char *format = getenv("MISHELL_PS1");
+	if (format == NULL)
+		format = PROMPT_DEFAULT_FORMAT;
+
+	char cwd[1024], hostname[256];
+	const char *user = getenv("USER");
+	if (user == NULL) {
+		struct passwd *pw = getpwuid(getuid());
+		user = pw ? pw->pw_name : "?";
+	}
+	if (gethostname(hostname, sizeof(hostname)) == -1)
+		strcpy(hostname, "?");
+	hostname[sizeof(hostname) - 1] = 0;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		strcpy(cwd, "?");
+
+	static_len = 0;
+	segment_count = 0;
+	for (const char *p = format; *p; p++) {
+		if (*p != '\\' || p[1] == 0) {
+			append_static(p, 1);
+			continue;
+		}
+		const char *s;
+		switch (*++p) {
+		case 'u':
+			append_static(user, strlen(user));
+			break;
+		case 'h':
+			append_static(hostname, strcspn(hostname, "."));
+			break;
+		case 'H':
+			append_static(hostname, strlen(hostname));
+			break;
+		case 'w':
+			append_static(cwd, strlen(cwd));
+			break;
+		case 'W':
+			s = strrchr(cwd, '/');
+			s = (s && s[1]) ? s + 1 : cwd;
+			append_static(s, strlen(s));
+			break;
+		case 's':
+			append_static(sysname, strlen(sysname));
+			break;
+		case '$':
+			append_static(geteuid() == 0 ? "#" : "$", 1);
+			break;
+		case 'n':
+			append_static("\n", 1);
+			break;
+		case '?':
+			append_dynamic(SEG_STATUS);
+			break;
+		case 'd':
+			append_dynamic(SEG_DURATION);
+			break;
+		case 'j':
+			append_dynamic(SEG_JOBS);
+			break;
+		default: // unknown escapes (and \\) stand for themselves
+			append_static(p, 1);
+			break;
+		}
+	}
+	cache_valid = true;
+}
+
+static int format_duration(char *out, size_t size, long long ns) {
+	if (ns < 1000000LL)
+		return snprintf(out, size, "%lldus", ns / 1000);
+	if (ns < 1000000000LL)
+		return snprintf(out, size, "%lldms", ns / 1000000);
+	return snprintf(out, size, "%lld.%02llds", ns / 1000000000LL,
+					(ns / 10000000LL) % 100);
+}
+
+int prompt_render(void) {
+	char out[PROMPT_MAX * 2];
+	size_t len = 0;
+
+	if (!cache_valid)
+		compile_format();
+
+	for (int i = 0; i < segment_count; i++) {
+		struct segment *seg = &segments[i];
+		size_t room = sizeof(out) - len;
+		int n = 0;
+		switch (seg->kind) {
+		case SEG_TEXT:
+			memcpy(out + len, static_text + seg->start, seg->len);
+			n = seg->len;
+			break;
+		case SEG_STATUS:
+			n = snprintf(out + len, room, "%d", prompt_status);
+			break;
+		case SEG_DURATION:
+			n = format_duration(out + len, room, last_duration_ns);
+			break;
+		case SEG_JOBS:
+			n = snprintf(out + len, room, "%d", job_count);
+			break;
+		}
+		if (n > 0 && (size_t)n < room)
+			len += n;
+	}
+
+	// anything a builtin left in the stdio buffer goes out first
+	fflush(stdout);
+	if (write(STDOUT_FILENO, out, len) == -1)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+/*
+ * Cached prompt rendering. The format comes from MISHELL_PS1 and may use
+ *   \u user        \h host (up to the first '.')   \H full host
+ *   \w cwd         \W basename of cwd             \s shell name
+ *   \? exit status of the last command
+ *   \d duration of the last command               \j background jobs
+ *   \$ '#' for root, '$' otherwise                \n newline   \\ backslash
+ * User, host and cwd are looked up once and kept until prompt_invalidate.
+ */
+
+/**
+ * Drop the cached user/host/cwd/format, e.g. after cd or export
+ */
+void prompt_invalidate(void);
+
+/**
+ * Record the outcome of the last command for \? and \d
+ * @param status      exit status
+ * @param duration_ns wall time it took
+ */
+void prompt_set_status(int status, long long duration_ns);
+
+/**
+ * Record the number of running background jobs for \j
+ */
+void prompt_set_jobs(int jobs);
+
+/**
+ * Render the prompt into one buffer and emit it with a single write
+ * @return 0, -1 if the write failed
+ */
+int prompt_render(void);
+
+#endif
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "redirect.h"
+#include "shell.h"
+
+bool redirect_parse(const char *word, struct redirect *redirect) {
+	const char *p = word;
+	memset(redirect, 0, sizeof(*redirect));
+
+	if (p[0] == '&' && p[1] == '>') {
+		p += 2;
+		redirect->fd = STDOUT_FILENO;
+		redirect->kind = REDIRECT_OUT_ERR;
+		if (*p == '>') {
+			redirect->kind = REDIRECT_APPEND_ERR;
+			p++;
+		}
+	} else if (p[0] == '<' && p[1] == '<' && p[2] == '<') {
+		p += 3;
+		redirect->fd = STDIN_FILENO;
+		redirect->kind = REDIRECT_HERE_STRING;
+	} else {
+		int fd = -1;
+		if (*p >= '0' && *p <= '9' && (p[1] == '<' || p[1] == '>'))
+			fd = *p++ - '0';
+
+		if (*p == '<') {
+			p++;
+			redirect->fd = fd == -1 ? STDIN_FILENO : fd;
+			redirect->kind = REDIRECT_IN;
+		} else if (*p == '>') {
+			p++;
+			redirect->fd = fd == -1 ? STDOUT_FILENO : fd;
+			redirect->kind = REDIRECT_OUT;
+			if (*p == '>') {
+				redirect->kind = REDIRECT_APPEND;
+				p++;
+			} else if (*p == '&' && p[1] >= '0' && p[1] <= '9' && !p[2]) {
+				redirect->kind = REDIRECT_DUP;
+				redirect->source_fd = p[1] - '0';
+				return true;
+			}
+		} else {
+			return false;
+		}
+	}
+
+	if (*p)
+		redirect->target = strdup(p);
+	return true;
+}
+
+bool redirect_needs_target(const struct redirect *redirect) {
+	return redirect->kind != REDIRECT_DUP && redirect->target == NULL;
+}
+
+static int open_flags(enum redirect_kind kind) {
+	switch (kind) {
+	case REDIRECT_IN:
+		return O_RDONLY;
+	case REDIRECT_OUT:
+	case REDIRECT_OUT_ERR:
+		return O_WRONLY | O_CREAT | O_TRUNC;
+	default:
+		return O_WRONLY | O_CREAT | O_APPEND;
+	}
+}
+
+/**
+ * Open what a redirection reads from or writes to
+ * @return close-on-exec fd, -1 after printing an error
+ */
+static int open_target(const struct redirect *redirect) {
+	int fd;
+	if (redirect->kind == REDIRECT_HERE_STRING) {
+		// a memfd never blocks the writer the way a pipe would
+		fd = memfd_create("here-string", MFD_CLOEXEC);
+		if (fd != -1) {
+			size_t len = strlen(redirect->target);
+			if (write(fd, redirect->target, len) != (ssize_t)len ||
+				write(fd, "\n", 1) != 1 || lseek(fd, 0, SEEK_SET) == -1) {
+				close(fd);
+				fd = -1;
+			}
+		}
+	} else {
+		fd = open(redirect->target, open_flags(redirect->kind) | O_CLOEXEC,
+				  0644);
+	}
+
+	if (fd == -1) {
+		fprintf(stderr, "-%s: %s: %s\n", sysname,
+				redirect->kind == REDIRECT_HERE_STRING ? "<<<" :
+														 redirect->target,
+				strerror(errno));
+	}
+	return fd;
+}
+
+int redirect_apply(const struct redirect *redirects, int count) {
+	for (int i = 0; i < count; i++) {
+		const struct redirect *r = &redirects[i];
+
+		if (r->kind == REDIRECT_DUP) {
+			if (dup2(r->source_fd, r->fd) == -1) {
+				fprintf(stderr, "-%s: %d: %s\n", sysname, r->source_fd,
+						strerror(errno));
+				return -1;
+			}
+			continue;
+		}
+
+		int fd = open_target(r);
+		if (fd == -1)
+			return -1;
+		int status = dup2(fd, r->fd);
+		if (status != -1 && (r->kind == REDIRECT_OUT_ERR ||
+							 r->kind == REDIRECT_APPEND_ERR))
+			status = dup2(fd, STDERR_FILENO);
+		if (fd != r->fd)
+			close(fd);
+		if (status == -1) {
+			fprintf(stderr, "-%s: %s\n", sysname, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int redirect_apply_fds(const struct redirect *redirects, int count,
+					   int *in_fd, int *out_fd) {
+	for (int i = 0; i < count; i++) {
+		const struct redirect *r = &redirects[i];
+		int *slot = r->fd == STDIN_FILENO ? in_fd : out_fd;
+
+		int fd;
+		if (r->kind == REDIRECT_DUP) {
+			int *source = r->source_fd == STDIN_FILENO ? in_fd : out_fd;
+			fd = fcntl(*source, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+		} else {
+			fd = open_target(r);
+		}
+		if (fd == -1)
+			return -1;
+		if (*slot > STDERR_FILENO)
+			close(*slot);
+		*slot = fd;
+	}
+	return 0;
+}
+
+bool redirect_needs_process(const struct redirect *redirects, int count) {
+	for (int i = 0; i < count; i++) {
+		const struct redirect *r = &redirects[i];
+		if (r->fd > STDOUT_FILENO || r->kind == REDIRECT_OUT_ERR ||
+			r->kind == REDIRECT_APPEND_ERR)
+			return true;
+		if (r->kind == REDIRECT_DUP && r->source_fd > STDOUT_FILENO)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Whether fd is already in the saved list
+ */
+static bool is_saved(const struct redirect_saved *saved, int count, int fd) {
+	for (int i = 0; i < count; i++) {
+		if (saved[i].fd == fd)
+			return true;
+	}
+	return false;
+}
+
+int redirect_save(const struct redirect *redirects, int count,
+				  struct redirect_saved **saved) {
+	// the copies go above every fd a redirection can write to, so that
+	// redirect_apply never replaces one of them
+	int above = STDERR_FILENO;
+	for (int i = 0; i < count; i++) {
+		if (redirects[i].fd > above)
+			above = redirects[i].fd;
+	}
+
+	fflush(stdout);
+	*saved = malloc(sizeof(struct redirect_saved) * (count + 1));
+	int saved_count = 0;
+	for (int i = 0; i < count; i++) {
+		const struct redirect *r = &redirects[i];
+		int fds[2] = { r->fd, -1 };
+		if (r->kind == REDIRECT_OUT_ERR || r->kind == REDIRECT_APPEND_ERR)
+			fds[1] = STDERR_FILENO;
+		for (int j = 0; j < 2; j++) {
+			if (fds[j] == -1 || is_saved(*saved, saved_count, fds[j]))
+				continue;
+			// a copy of -1 means the fd was closed and is closed again
+			int copy = fcntl(fds[j], F_DUPFD_CLOEXEC, above + 1);
+			(*saved)[saved_count++] = (struct redirect_saved){ fds[j], copy };
+		}
+	}
+	return saved_count;
+}
+
+void redirect_restore(struct redirect_saved *saved, int count) {
+	fflush(stdout);
+	for (int i = 0; i < count; i++) {
+		if (saved[i].copy == -1) {
+			close(saved[i].fd);
+			continue;
+		}
+		dup2(saved[i].copy, saved[i].fd);
+		close(saved[i].copy);
+	}
+	free(saved);
+}
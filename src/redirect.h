@@ -0,0 +1,83 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <stdbool.h>
+
+enum redirect_kind {
+	REDIRECT_IN, // n<file
+	REDIRECT_OUT, // n>file
+	REDIRECT_APPEND, // n>>file
+	REDIRECT_DUP, // n>&m
+	REDIRECT_OUT_ERR, // &>file
+	REDIRECT_APPEND_ERR, // &>>file
+	REDIRECT_HERE_STRING, // <<<word
+};
+
+struct redirect {
+	enum redirect_kind kind;
+	int fd; // fd being redirected
+	int source_fd; // for n>&m, the m
+	char *target; // file name or here-string text
+};
+
+/**
+ * Recognise a redirection operator at the start of a word
+ * @param  word     word from the command line, e.g. "2>err.log" or ">>"
+ * @param  redirect filled in when word is a redirection; target is a copy
+ *                  of the rest of the word, or NULL when the target is the
+ *                  next word
+ * @return          true if word is a redirection
+ */
+bool redirect_parse(const char *word, struct redirect *redirect);
+
+/**
+ * Whether the redirection still needs its target from the next word
+ */
+bool redirect_needs_target(const struct redirect *redirect);
+
+/**
+ * Apply redirections in order to the calling process with dup2. Files are
+ * opened O_CLOEXEC and closed again once duplicated.
+ * @param  redirects redirections in command line order
+ * @param  count     number of redirections
+ * @return           0, -1 after printing an error if one failed
+ */
+int redirect_apply(const struct redirect *redirects, int count);
+
+/**
+ * Apply redirections of stdin/stdout to a pair of fds instead of the
+ * process, for builtins running on a thread. Replaced fds above stderr
+ * are closed.
+ * @return 0, -1 after printing an error if one failed
+ */
+int redirect_apply_fds(const struct redirect *redirects, int count,
+					   int *in_fd, int *out_fd);
+
+/**
+ * Whether the redirections touch anything besides stdin/stdout, which
+ * only a separate process can take
+ */
+bool redirect_needs_process(const struct redirect *redirects, int count);
+
+// an fd a builtin's redirections replace, and the copy to put back
+struct redirect_saved {
+	int fd;
+	int copy; // close-on-exec, -1 if fd was not open
+};
+
+/**
+ * Keep copies of every fd the redirections replace, to restore after a
+ * builtin ran with them inside the shell
+ * @param  saved set to the copies, to be given to redirect_restore
+ * @return       number of copies
+ */
+int redirect_save(const struct redirect *redirects, int count,
+				  struct redirect_saved **saved);
+
+/**
+ * Put back the fds kept by redirect_save, closing the ones that were not
+ * open before, and close the copies
+ */
+void redirect_restore(struct redirect_saved *saved, int count);
+
+#endif
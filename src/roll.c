@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <unistd.h>
+
+#include "roll.h"
+#include "timing.h"
+
+#define ROLL_CHUNK_MIN 65536 // trials per chunk
+#define ROLL_CHUNKS_MAX 65536 // chunks grow past ROLL_CHUNK_MIN beyond this
+#define ROLL_BATCH 4096 // dice generated at once
+#define ROLL_THREADS_MAX 64
+#define HISTOGRAM_LINES 40
+#define HISTOGRAM_BAR 40
+
+#define GOLDEN_GAMMA 0x9e3779b97f4a7c15ULL
+
+static uint64_t splitmix64(uint64_t *state) {
+	uint64_t z = (*state += GOLDEN_GAMMA);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void roll_seed(struct roll_rng *rng, uint64_t seed, uint64_t stream) {
+	// four splitmix64 outputs per stream, so no two streams share a word
+	uint64_t state = seed + stream * 4 * GOLDEN_GAMMA;
+	for (int i = 0; i < 4; i++)
+		rng->s[i] = splitmix64(&state);
+}
+
+uint64_t roll_random_seed(void) {
+	uint64_t seed;
+	if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed))
+		return seed;
+	return (uint64_t)timing_now_ns() ^ ((uint64_t)getpid() << 32);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t roll_next(struct roll_rng *rng) {
+	uint64_t *s = rng->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+/*
+ * Lemire's multiply-shift reduction: the high half of x * sides is a die
+ * face, uniform once the x whose low half falls below (2^32 - sides) %
+ * sides are drawn again. That costs one division per batch instead of one
+ * per die, and a redraw is rare for any sensible die.
+ */
+static inline uint32_t rejection_threshold(uint32_t sides) {
+	return (uint32_t)-sides % sides;
+}
+
+uint32_t roll_die(struct roll_rng *rng, uint32_t sides) {
+	uint32_t threshold = rejection_threshold(sides);
+	for (;;) {
+		uint64_t m = (roll_next(rng) >> 32) * sides;
+		if ((uint32_t)m >= threshold)
+			return (m >> 32) + 1;
+	}
+}
+
+/**
+ * Fill buf with dice, two per generator output
+ */
+static void fill_dice(struct roll_rng *rng, uint32_t sides,
+					  uint32_t threshold, uint32_t *buf, size_t count) {
+	size_t i = 0;
+	while (i < count) {
+		uint64_t r = roll_next(rng);
+		uint64_t hi = (r >> 32) * sides, lo = (r & 0xffffffffu) * sides;
+		if ((uint32_t)hi >= threshold)
+			buf[i++] = (hi >> 32) + 1;
+		if ((uint32_t)lo >= threshold && i < count)
+			buf[i++] = (lo >> 32) + 1;
+	}
+}
+
+// mean and variance of one chunk, merged in chunk order in the end
+struct chunk_result {
+	long long count;
+	double mean, m2;
+	uint64_t min, max;
+};
+
+struct simulation {
+	long long trials, chunk_trials, chunk_count;
+	int dice;
+	uint32_t sides;
+	uint64_t seed;
+	uint64_t bins; // histogram size, 0 without one
+	atomic_llong next_chunk;
+	struct chunk_result *chunks;
+};
+
+struct worker {
+	struct simulation *sim;
+	pthread_t thread;
+	uint64_t *histogram;
+};
+
+static void run_chunk(struct simulation *sim, long long chunk,
+					  uint32_t *batch, uint64_t *histogram) {
+	struct chunk_result *res = &sim->chunks[chunk];
+	long long first = chunk * sim->chunk_trials;
+	long long count = sim->trials - first < sim->chunk_trials ?
+						  sim->trials - first :
+						  sim->chunk_trials;
+	uint32_t threshold = rejection_threshold(sim->sides);
+	struct roll_rng rng;
+	roll_seed(&rng, sim->seed, chunk);
+
+	res->min = UINT64_MAX;
+	long long dice_left = count * sim->dice;
+	size_t pos = 0, filled = 0;
+	uint64_t sum = 0;
+	int in_trial = 0;
+	while (res->count < count) {
+		if (pos == filled) {
+			filled = dice_left < ROLL_BATCH ? dice_left : ROLL_BATCH;
+			fill_dice(&rng, sim->sides, threshold, batch, filled);
+			dice_left -= filled;
+			pos = 0;
+		}
+		sum += batch[pos++];
+		if (++in_trial < sim->dice)
+			continue;
+
+		// Welford's update stays accurate over billions of trials
+		double delta = (double)sum - res->mean;
+		res->mean += delta / ++res->count;
+		res->m2 += delta * ((double)sum - res->mean);
+		if (sum < res->min)
+			res->min = sum;
+		if (sum > res->max)
+			res->max = sum;
+		if (histogram != NULL)
+			histogram[sum - sim->dice]++;
+		sum = 0;
+		in_trial = 0;
+	}
+}
+
+static void *simulate_worker(void *arg) {
+	struct worker *w = arg;
+	struct simulation *sim = w->sim;
+	uint32_t *batch = malloc(sizeof(uint32_t) * ROLL_BATCH);
+	for (;;) {
+		long long chunk = atomic_fetch_add(&sim->next_chunk, 1);
+		if (chunk >= sim->chunk_count)
+			break;
+		run_chunk(sim, chunk, batch, w->histogram);
+	}
+	free(batch);
+	return NULL;
+}
+
+void roll_simulate(long long trials, int dice, uint32_t sides, uint64_t seed,
+				   int threads, struct roll_stats *stats) {
+	struct simulation sim = { 0 };
+	sim.trials = trials;
+	sim.dice = dice;
+	sim.sides = sides;
+	sim.seed = seed;
+	sim.chunk_trials = (trials + ROLL_CHUNKS_MAX - 1) / ROLL_CHUNKS_MAX;
+	if (sim.chunk_trials < ROLL_CHUNK_MIN)
+		sim.chunk_trials = ROLL_CHUNK_MIN;
+	sim.chunk_count = (trials + sim.chunk_trials - 1) / sim.chunk_trials;
+	sim.chunks = calloc(sim.chunk_count, sizeof(struct chunk_result));
+	uint64_t bins = (uint64_t)dice * (sides - 1) + 1;
+	sim.bins = bins <= ROLL_HISTOGRAM_MAX ? bins : 0;
+	atomic_init(&sim.next_chunk, 0);
+
+	if (threads > sim.chunk_count)
+		threads = sim.chunk_count;
+	if (threads > ROLL_THREADS_MAX)
+		threads = ROLL_THREADS_MAX;
+	if (threads < 1)
+		threads = 1;
+	struct worker *workers = calloc(threads, sizeof(struct worker));
+	int started = 1;
+	for (int i = 0; i < threads; i++) {
+		workers[i].sim = &sim;
+		if (sim.bins)
+			workers[i].histogram = calloc(sim.bins, sizeof(uint64_t));
+	}
+	// the calling thread is the first worker, so a failed start only costs
+	// speed
+	for (; started < threads; started++) {
+		if (pthread_create(&workers[started].thread, NULL, simulate_worker,
+						   &workers[started]) != 0)
+			break;
+	}
+	simulate_worker(&workers[0]);
+	for (int i = 1; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->dice = dice;
+	stats->sides = sides;
+	stats->seed = seed;
+	stats->min = UINT64_MAX;
+	for (long long c = 0; c < sim.chunk_count; c++) {
+		// Chan et al.: combine two partial means and sums of squares
+		const struct chunk_result *res = &sim.chunks[c];
+		long long n = stats->trials + res->count;
+		double delta = res->mean - stats->mean;
+		stats->m2 += res->m2 +
+					 delta * delta * stats->trials * res->count / n;
+		stats->mean += delta * res->count / n;
+		stats->trials = n;
+		if (res->min < stats->min)
+			stats->min = res->min;
+		if (res->max > stats->max)
+			stats->max = res->max;
+	}
+	if (sim.bins) {
+		stats->histogram = workers[0].histogram;
+		for (int i = 1; i < threads; i++) {
+			for (uint64_t b = 0; b < sim.bins; b++)
+				stats->histogram[b] += workers[i].histogram[b];
+			free(workers[i].histogram);
+		}
+	}
+	free(workers);
+	free(sim.chunks);
+}
+
+void roll_report(const struct roll_stats *stats, int out_fd) {
+	double sides = stats->sides;
+	double expected_mean = stats->dice * (sides + 1) / 2;
+	double expected_variance = stats->dice * (sides * sides - 1) / 12;
+
+	dprintf(out_fd, "%lld rolls of %dd%u, seed %llu\n", stats->trials,
+			stats->dice, stats->sides, (unsigned long long)stats->seed);
+	dprintf(out_fd, "mean     %.4f (expected %.4f)\n", stats->mean,
+			expected_mean);
+	dprintf(out_fd, "variance %.4f (expected %.4f)\n",
+			stats->m2 / stats->trials, expected_variance);
+	dprintf(out_fd, "min %llu, max %llu\n", (unsigned long long)stats->min,
+			(unsigned long long)stats->max);
+	if (stats->histogram == NULL)
+		return;
+
+	// one line per sum, or per range of sums when there are too many
+	uint64_t span = stats->max - stats->min + 1;
+	uint64_t width = (span + HISTOGRAM_LINES - 1) / HISTOGRAM_LINES;
+	uint64_t largest = 0;
+	for (uint64_t v = stats->min; v <= stats->max; v += width) {
+		uint64_t count = 0;
+		for (uint64_t s = v; s < v + width && s <= stats->max; s++)
+			count += stats->histogram[s - stats->dice];
+		if (count > largest)
+			largest = count;
+	}
+
+	int label_width =
+		snprintf(NULL, 0, "%llu", (unsigned long long)stats->max);
+	if (width > 1)
+		label_width = label_width * 2 + 1;
+	for (uint64_t v = stats->min; v <= stats->max; v += width) {
+		uint64_t last = v + width - 1;
+		if (last > stats->max)
+			last = stats->max;
+		uint64_t count = 0;
+		for (uint64_t s = v; s <= last; s++)
+			count += stats->histogram[s - stats->dice];
+
+		char label[48], bar[HISTOGRAM_BAR + 1];
+		if (width > 1)
+			snprintf(label, sizeof(label), "%llu-%llu", (unsigned long long)v,
+					 (unsigned long long)last);
+		else
+			snprintf(label, sizeof(label), "%llu", (unsigned long long)v);
+		int len = (count * HISTOGRAM_BAR + largest / 2) / largest;
+		memset(bar, '#', len);
+		bar[len] = 0;
+		dprintf(out_fd, "%*s |%-*s %12llu %6.2f%%\n", label_width, label,
+				HISTOGRAM_BAR, bar, (unsigned long long)count,
+				100.0 * count / stats->trials);
+	}
+}
+
+void roll_stats_free(struct roll_stats *stats) {
+	free(stats->histogram);
+	stats->histogram = NULL;
+}
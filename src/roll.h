@@ -0,0 +1,68 @@
+#ifndef ROLL_H
+#define ROLL_H
+
+#include <stdint.h>
+
+// largest histogram kept, wider sum ranges only get mean and variance
+#define ROLL_HISTOGRAM_MAX (1 << 16)
+
+/*
+ * xoshiro256** state. Seeded through splitmix64, so any 64-bit seed,
+ * including 0, gives a usable state.
+ */
+struct roll_rng {
+	uint64_t s[4];
+};
+
+/*
+ * Outcome of a simulation: the sum of the dice of every trial went into
+ * the running mean and variance, and into the histogram when its range
+ * fits in ROLL_HISTOGRAM_MAX bins
+ */
+struct roll_stats {
+	long long trials;
+	int dice;
+	uint32_t sides;
+	uint64_t seed;
+	double mean;
+	double m2; // sum of squared differences from the mean
+	uint64_t min, max;
+	uint64_t *histogram; // histogram[i] counts sums of dice + i, or NULL
+};
+
+/**
+ * Seed a generator
+ * @param rng    state to set
+ * @param seed   seed
+ * @param stream independent stream of the same seed, 0 for the first
+ */
+void roll_seed(struct roll_rng *rng, uint64_t seed, uint64_t stream);
+
+/**
+ * Seed that differs between calls, for when the user gave none
+ */
+uint64_t roll_random_seed(void);
+
+/**
+ * One die, uniform in 1..sides without modulo bias
+ * @param  sides at least 1
+ */
+uint32_t roll_die(struct roll_rng *rng, uint32_t sides);
+
+/**
+ * Roll <dice>d<sides> trials times and collect the statistics of the sums.
+ * Trials are split into chunks with a stream of their own, spread over up
+ * to threads threads, so the outcome only depends on the seed.
+ * @param stats filled in, histogram to be freed with roll_stats_free
+ */
+void roll_simulate(long long trials, int dice, uint32_t sides, uint64_t seed,
+				   int threads, struct roll_stats *stats);
+
+/**
+ * Print mean, variance, their expected values and the histogram
+ */
+void roll_report(const struct roll_stats *stats, int out_fd);
+
+void roll_stats_free(struct roll_stats *stats);
+
+#endif
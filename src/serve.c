@@ -0,0 +1,559 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pathcache.h"
+#include "serve.h"
+#include "shell.h"
+#include "timing.h"
+
+#define SERVE_BACKLOG 64
+#define SERVE_EVENTS 64
+#define READ_CHUNK 65536
+#define OUTPUT_HIGH (1 << 20) // stop reading a command's output above this
+#define INPUT_HIGH READ_CHUNK // stop reading a client above this
+#define LINE_MAX_LEN 4096 // same as the interactive prompt
+#define LINE_TOO_LONG 2 // exit status of a rejected line
+#define STOP_GRACE_NS 2000000000LL // SIGTERM to SIGKILL when shutting down
+#define STOP_POLL_US 10000
+
+enum watch_role { WATCH_SOCKET, WATCH_STDOUT, WATCH_STDERR, WATCH_PID };
+
+struct client;
+
+// what an epoll event is about, kept inside its client
+struct watch {
+	struct client *client;
+	enum watch_role role;
+};
+
+struct client {
+	int fd;
+	struct watch watches[4];
+	char *in; // received, not yet run
+	size_t in_len, in_cap;
+	bool too_long; // dropping the rest of a line until its '\n'
+	bool eof; // the client sent all its lines
+	char *out; // frames not yet sent
+	size_t out_len, out_pos, out_cap;
+	unsigned int socket_events; // what the socket is watched for
+
+	// the running command line
+	bool running;
+	pid_t pid;
+	pid_t pgid; // the line's process group, with every stage it started
+	int pidfd, out_fd, err_fd;
+	int status;
+	bool paused; // output pipes off while the client catches up
+
+	bool hung_up; // gone, free once the running command finished
+	bool dead; // freed after the current batch of events
+	struct client *next_dead;
+	struct client *prev, *next; // live clients
+};
+
+static int epoll_fd;
+static struct client *dead_clients;
+static struct client *clients;
+static sigset_t blocked_signals;
+
+static void watch_add(int fd, struct watch *watch, unsigned int events) {
+	struct epoll_event ev = { .events = events, .data.ptr = watch };
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void watch_mod(int fd, struct watch *watch, unsigned int events) {
+	struct epoll_event ev = { .events = events, .data.ptr = watch };
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void watch_close(int *fd) {
+	if (*fd == -1)
+		return;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+	close(*fd);
+	*fd = -1;
+}
+
+static void add_output(struct client *c, const char *data, size_t len) {
+	if (c->out_pos > 0 && c->out_pos == c->out_len)
+		c->out_pos = c->out_len = 0;
+	if (c->out_len + len > c->out_cap) {
+		while (c->out_len + len > c->out_cap)
+			c->out_cap = c->out_cap ? c->out_cap * 2 : 65536;
+		c->out = realloc(c->out, c->out_cap);
+	}
+	memcpy(c->out + c->out_len, data, len);
+	c->out_len += len;
+}
+
+static void add_frame(struct client *c, char type, const char *data,
+					  size_t len) {
+	char header[32];
+	int n = snprintf(header, sizeof(header), "%c %zu\n", type, len);
+	add_output(c, header, n);
+	add_output(c, data, len);
+}
+
+static void set_paused(struct client *c, bool paused) {
+	if (c->paused == paused)
+		return;
+	c->paused = paused;
+	unsigned int events = paused ? 0 : EPOLLIN;
+	if (c->out_fd != -1)
+		watch_mod(c->out_fd, &c->watches[WATCH_STDOUT], events);
+	if (c->err_fd != -1)
+		watch_mod(c->err_fd, &c->watches[WATCH_STDERR], events);
+}
+
+/**
+ * Read from the socket while the client has lines to send and they don't
+ * pile up, write to it while there are frames to send
+ */
+static void update_socket(struct client *c) {
+	if (c->hung_up)
+		return;
+	unsigned int events = 0;
+	if (!c->eof && c->in_len < INPUT_HIGH)
+		events |= EPOLLIN;
+	if (c->out_pos < c->out_len)
+		events |= EPOLLOUT;
+	if (events != c->socket_events) {
+		c->socket_events = events;
+		watch_mod(c->fd, &c->watches[WATCH_SOCKET], events);
+	}
+}
+
+/**
+ * Drop a client. Later events of the same epoll batch may still point at
+ * it, so the memory goes only once the batch is done.
+ */
+static void client_free(struct client *c) {
+	if (c->dead)
+		return;
+	watch_close(&c->fd);
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		clients = c->next;
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+	c->dead = true;
+	c->next_dead = dead_clients;
+	dead_clients = c;
+}
+
+/**
+ * The client is gone: drop the frames it is owed and keep draining the
+ * pipes of a running command, so that it can finish and be reaped
+ */
+static void hang_up(struct client *c) {
+	c->hung_up = true;
+	c->out_pos = c->out_len = 0;
+	set_paused(c, false);
+	// keep the fd until the client is freed, but stop hearing the hang up
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+}
+
+/**
+ * Send what the socket takes now, EPOLLOUT picks up the rest
+ */
+static void flush_output(struct client *c) {
+	while (c->out_pos < c->out_len) {
+		ssize_t n = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos,
+						 MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && errno == EAGAIN)
+			break;
+		if (n == -1) {
+			hang_up(c);
+			return;
+		}
+		c->out_pos += n;
+	}
+	update_socket(c);
+	set_paused(c, c->out_len - c->out_pos > OUTPUT_HIGH);
+}
+
+/**
+ * Body of the child running one command line. Never returns.
+ */
+static void run_line(char *line, int out_fd, int err_fd) {
+	sigprocmask(SIG_UNBLOCK, &blocked_signals, NULL);
+	setpgid(0, 0); // so that stopping the server reaches the whole line
+	int null_fd = open("/dev/null", O_RDONLY);
+	dup2(null_fd, STDIN_FILENO);
+	dup2(out_fd, STDOUT_FILENO);
+	dup2(err_fd, STDERR_FILENO);
+	// the listening socket, epoll and the other clients stay with the
+	// server
+	close_range(STDERR_FILENO + 1, ~0U, 0);
+
+	struct command_t *command = calloc(1, sizeof(struct command_t));
+	parse_command(line, command);
+	process_command(command);
+	free_command(command);
+	fflush(stdout);
+	_exit(last_status);
+}
+
+static void start_next(struct client *c);
+
+/**
+ * Answer a line that did not run with an error and its exit status
+ */
+static void reject_line(struct client *c, const char *error, int status) {
+	char message[256];
+	int n = snprintf(message, sizeof(message), "-%s: %s\n", sysname, error);
+	add_frame(c, 'E', message, n);
+	n = snprintf(message, sizeof(message), "X %d\n", status);
+	add_output(c, message, n);
+	flush_output(c);
+	start_next(c);
+}
+
+/**
+ * Run the next line of an idle client, or free the client once it is done:
+ * when it is gone, or when it sent all its lines and got all their frames
+ */
+static void start_next(struct client *c) {
+	if (c->running || c->dead)
+		return;
+	if (c->hung_up) {
+		client_free(c);
+		return;
+	}
+	char *nl = memchr(c->in, '\n', c->in_len);
+	if (nl == NULL) {
+		if (c->eof && c->out_pos == c->out_len)
+			client_free(c);
+		return;
+	}
+
+	size_t len = nl - c->in;
+	char line[LINE_MAX_LEN];
+	bool too_long = len >= sizeof(line);
+	if (!too_long) {
+		memcpy(line, c->in, len);
+		line[len] = 0;
+		if (len > 0 && line[len - 1] == '\r')
+			line[len - 1] = 0;
+	}
+	c->in_len -= nl + 1 - c->in;
+	memmove(c->in, nl + 1, c->in_len);
+	update_socket(c);
+	if (too_long) {
+		char error[64];
+		snprintf(error, sizeof(error), "line longer than %d bytes",
+				 LINE_MAX_LEN - 1);
+		reject_line(c, error, LINE_TOO_LONG);
+		return;
+	}
+
+	int out[2], err[2];
+	if (pipe2(out, O_CLOEXEC) == -1)
+		goto fail;
+	if (pipe2(err, O_CLOEXEC) == -1) {
+		close(out[0]);
+		close(out[1]);
+		goto fail;
+	}
+	// the child inherits the index, so PATH is only read again after it
+	// changed
+	path_cache_refresh(getenv("PATH"));
+	fflush(stdout); // don't let the child inherit pending output
+	pid_t pid = fork();
+	if (pid == 0)
+		run_line(line, out[1], err[1]);
+	close(out[1]);
+	close(err[1]);
+	if (pid == -1) {
+		close(out[0]);
+		close(err[0]);
+		goto fail;
+	}
+
+	c->running = true;
+	c->paused = false;
+	c->pid = pid;
+	c->pgid = pid;
+	setpgid(pid, pid); // also here, the child may not have run yet
+	c->out_fd = out[0];
+	c->err_fd = err[0];
+	c->pidfd = pidfd_open(pid, 0);
+	watch_add(c->out_fd, &c->watches[WATCH_STDOUT], EPOLLIN);
+	watch_add(c->err_fd, &c->watches[WATCH_STDERR], EPOLLIN);
+	if (c->pidfd != -1) {
+		watch_add(c->pidfd, &c->watches[WATCH_PID], EPOLLIN);
+	} else {
+		// can't watch it, the exit is collected once the pipes close
+		c->pid = -pid;
+	}
+	return;
+
+fail:
+	reject_line(c, strerror(errno), 126);
+}
+
+/**
+ * The command line is done once it exited and both pipes are drained
+ */
+static void check_finished(struct client *c) {
+	if (!c->running || c->out_fd != -1 || c->err_fd != -1)
+		return;
+	if (c->pid < 0) {
+		waitpid(-c->pid, &c->status, 0);
+		c->pid = 0;
+	}
+	if (c->pid != 0)
+		return;
+
+	int status = WIFEXITED(c->status) ? WEXITSTATUS(c->status) :
+										128 + WTERMSIG(c->status);
+	char frame[32];
+	int n = snprintf(frame, sizeof(frame), "X %d\n", status);
+	add_output(c, frame, n);
+	c->running = false;
+	flush_output(c);
+	start_next(c);
+}
+
+static void read_pipe(struct client *c, enum watch_role role) {
+	int *fd = role == WATCH_STDOUT ? &c->out_fd : &c->err_fd;
+	char buf[READ_CHUNK];
+	ssize_t n = read(*fd, buf, sizeof(buf));
+	if (n == -1 && errno == EINTR)
+		return;
+	if (n <= 0) {
+		watch_close(fd);
+		check_finished(c);
+		return;
+	}
+	if (!c->hung_up)
+		add_frame(c, role == WATCH_STDOUT ? 'O' : 'E', buf, n);
+	flush_output(c);
+}
+
+/**
+ * Take n received bytes, already at the end of c->in. Of a line of
+ * LINE_MAX_LEN bytes or more only the start is kept, for start_next to
+ * reject when its turn comes.
+ */
+static void take_input(struct client *c, size_t n) {
+	char *data = c->in + c->in_len;
+	if (c->too_long) {
+		char *nl = memchr(data, '\n', n);
+		if (nl == NULL)
+			return;
+		n -= nl - data;
+		memmove(data, nl, n);
+		c->too_long = false;
+	}
+	c->in_len += n;
+
+	char *nl = memrchr(c->in, '\n', c->in_len);
+	size_t start = nl == NULL ? 0 : nl + 1 - c->in;
+	if (c->in_len - start > LINE_MAX_LEN) {
+		c->in_len = start + LINE_MAX_LEN;
+		c->too_long = true;
+	}
+}
+
+static void read_socket(struct client *c) {
+	if (c->in_cap - c->in_len < READ_CHUNK) {
+		c->in_cap = c->in_cap ? c->in_cap * 2 : READ_CHUNK * 2;
+		c->in = realloc(c->in, c->in_cap);
+	}
+	ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+	if (n == -1 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n == -1) {
+		hang_up(c);
+		start_next(c);
+		return;
+	}
+	if (n == 0) {
+		// no more lines, but the ones sent still run and send their frames;
+		// a last line without '\n' counts too
+		c->eof = true;
+		if (c->in_len > 0 && c->in[c->in_len - 1] != '\n')
+			c->in[c->in_len++] = '\n';
+	} else {
+		take_input(c, n);
+	}
+	update_socket(c);
+	start_next(c);
+}
+
+static void accept_clients(int listen_fd) {
+	for (;;) {
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1)
+			return;
+		struct client *c = calloc(1, sizeof(*c));
+		c->fd = fd;
+		c->out_fd = c->err_fd = c->pidfd = -1;
+		for (int i = 0; i < 4; i++)
+			c->watches[i] = (struct watch){ c, i };
+		c->next = clients;
+		if (clients != NULL)
+			clients->prev = c;
+		clients = c;
+		c->socket_events = EPOLLIN;
+		watch_add(fd, &c->watches[WATCH_SOCKET], c->socket_events);
+	}
+}
+
+static void signal_line(struct client *c, int sig) {
+	if (c->pidfd != -1)
+		pidfd_send_signal(c->pidfd, sig, NULL, 0);
+	kill(-c->pgid, sig); // the stages the line started
+}
+
+/**
+ * Stop the running command lines and reap them: SIGTERM first, SIGKILL
+ * for those still there after STOP_GRACE_NS
+ */
+static void stop_clients(void) {
+	for (struct client *c = clients; c != NULL; c = c->next) {
+		if (c->running)
+			signal_line(c, SIGTERM);
+	}
+
+	long long deadline = timing_now_ns() + STOP_GRACE_NS;
+	for (struct client *c = clients; c != NULL; c = c->next) {
+		// 0 once reaped, negative without a pidfd
+		pid_t pid = c->pid < 0 ? -c->pid : c->pid;
+		if (!c->running || pid == 0)
+			continue;
+		while (waitpid(pid, NULL, WNOHANG) == 0) {
+			if (timing_now_ns() > deadline) {
+				signal_line(c, SIGKILL);
+				waitpid(pid, NULL, 0);
+				break;
+			}
+			usleep(STOP_POLL_US);
+		}
+	}
+}
+
+static int open_socket(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat st;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	// a socket left behind by an earlier server is replaced, unless that
+	// server is still answering
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) &&
+		connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 &&
+		errno == ECONNREFUSED)
+		unlink(path);
+
+	// commands run with the server's rights, only its user may connect
+	mode_t mask = umask(077);
+	int status = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (status == -1 || listen(fd, SERVE_BACKLOG) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int serve_main(const char *path) {
+	int listen_fd = open_socket(path);
+	if (listen_fd == -1) {
+		fprintf(stderr, "-%s: %s: %s\n", sysname, path, strerror(errno));
+		return 1;
+	}
+
+	sigemptyset(&blocked_signals);
+	sigaddset(&blocked_signals, SIGINT);
+	sigaddset(&blocked_signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &blocked_signals, NULL);
+	int signal_fd = signalfd(-1, &blocked_signals, SFD_CLOEXEC);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	struct watch listen_watch = { NULL, WATCH_SOCKET };
+	struct watch signal_watch = { NULL, WATCH_PID };
+	watch_add(listen_fd, &listen_watch, EPOLLIN);
+	watch_add(signal_fd, &signal_watch, EPOLLIN);
+	fprintf(stderr, "%s: serving on %s\n", sysname, path);
+
+	bool stop = false;
+	while (!stop) {
+		struct epoll_event events[SERVE_EVENTS];
+		int n = epoll_wait(epoll_fd, events, SERVE_EVENTS, -1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			break;
+
+		for (int i = 0; i < n; i++) {
+			struct watch *w = events[i].data.ptr;
+			struct client *c = w->client;
+			if (c != NULL && c->dead)
+				continue;
+			if (w == &listen_watch) {
+				accept_clients(listen_fd);
+			} else if (w == &signal_watch) {
+				stop = true;
+			} else if (w->role == WATCH_SOCKET) {
+				// a hang up also unpauses the output of a running command
+				if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+					hang_up(c);
+					start_next(c);
+					continue;
+				}
+				if (events[i].events & EPOLLOUT) {
+					flush_output(c);
+					start_next(c);
+				}
+				if (!c->dead && !c->hung_up &&
+					(events[i].events & EPOLLIN))
+					read_socket(c);
+			} else if (w->role == WATCH_PID) {
+				waitpid(c->pid, &c->status, 0);
+				c->pid = 0;
+				watch_close(&c->pidfd);
+				check_finished(c);
+			} else {
+				read_pipe(c, w->role);
+			}
+		}
+
+		while (dead_clients != NULL) {
+			struct client *c = dead_clients;
+			dead_clients = c->next_dead;
+			free(c->in);
+			free(c->out);
+			free(c);
+		}
+	}
+
+	stop_clients();
+	unlink(path);
+	close(listen_fd);
+	return 0;
+}
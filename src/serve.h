@@ -0,0 +1,21 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/**
+ * Serve command lines on a Unix socket until SIGINT/SIGTERM, which also
+ * terminate the lines still running and wait for them. Clients send
+ * one command line per '\n'; the lines of a client run one after the other
+ * in forked children of the server, so cd and export only last for their
+ * own line, and clients run concurrently. A client that shuts down its
+ * sending side still gets the replies to every line it sent; a line of
+ * 4096 bytes or more is not run and only gets an error and "X 2". Replies
+ * are frames of a header line and a payload:
+ *   "O <length>\n" and <length> bytes of stdout
+ *   "E <length>\n" and <length> bytes of stderr
+ *   "X <status>\n" once the command line finished
+ * @param  path socket path, replaced if it is a stale socket
+ * @return      exit status for main
+ */
+int serve_main(const char *path);
+
+#endif
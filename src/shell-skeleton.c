@@ -1,33 +1,38 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <termios.h> // termios, TCSANOW, ECHO, ICANON
 #include <unistd.h>
 #include <fcntl.h>
-#include <ctype.h>
-#include <dirent.h>
-#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "builtins.h"
+#include "complete.h"
+#include "dirscan.h"
+#include "expand.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "prompt.h"
+#include "redirect.h"
+#include "shell.h"
+#include "subst.h"
+#include "timing.h"
+#include "trace.h"
 
 const char *sysname = "mishell";
 
-enum return_codes {
-	SUCCESS = 0,
-	EXIT = 1,
-	UNKNOWN = 2,
-};
+#define CLOEXEC_FDS_MAX 256
 
-struct command_t {
-	char *name;
-	bool background;
-	bool auto_complete;
-	int arg_count;
-	char **args;
-	char *redirects[3]; // in/out redirection
-	struct command_t *next; // for piping
-};
+// directory listings read by glob expansion, for one command line
+static struct expand_cache *line_cache;
 
 /**
  * Prints a command struct
@@ -37,13 +42,15 @@ void print_command(struct command_t *command) {
 	int i = 0;
 	printf("Command: <%s>\n", command->name);
 	printf("\tIs Background: %s\n", command->background ? "yes" : "no");
-	printf("\tNeeds Auto-complete: %s\n",
-		   command->auto_complete ? "yes" : "no");
 	printf("\tRedirects:\n");
 
-	for (i = 0; i < 3; i++) {
-		printf("\t\t%d: %s\n", i,
-			   command->redirects[i] ? command->redirects[i] : "N/A");
+	static const char *ops[] = { "<", ">", ">>", ">&", "&>", "&>>", "<<<" };
+	for (i = 0; i < command->redirect_count; i++) {
+		struct redirect *r = &command->redirects[i];
+		if (r->kind == REDIRECT_DUP)
+			printf("\t\t%d%s%d\n", r->fd, ops[r->kind], r->source_fd);
+		else
+			printf("\t\t%d%s %s\n", r->fd, ops[r->kind], r->target);
 	}
 
 	printf("\tArguments (%d):\n", command->arg_count);
@@ -64,16 +71,18 @@ void print_command(struct command_t *command) {
  * @return         [description]
  */
 int free_command(struct command_t *command) {
+	if (command->subst_count)
+		subst_finish(command);
 	if (command->arg_count) {
 		for (int i = 0; i < command->arg_count; ++i)
 			free(command->args[i]);
 		free(command->args);
 	}
 
-	for (int i = 0; i < 3; ++i) {
-		if (command->redirects[i])
-			free(command->redirects[i]);
-	}
+	for (int i = 0; i < command->redirect_count; ++i)
+		free(command->redirects[i].target);
+	free(command->redirects);
+	free(command->launch);
 
 	if (command->next) {
 		free_command(command->next);
@@ -87,23 +96,17 @@ int free_command(struct command_t *command) {
 
 /**
  * Show the command prompt
- * @return [description]
+ * @return 0, -1 if it could not be written
  */
 int show_prompt(void) {
-	char cwd[1024], hostname[1024];
-	gethostname(hostname, sizeof(hostname));
-	getcwd(cwd, sizeof(cwd));
-	printf("%s@%s:%s %s$ ", getenv("USER"), hostname, cwd, sysname);
-	return 0;
+	return prompt_render();
 }
 
 /**
- * Parse a command string into a command struct
- * @param  buf     [description]
- * @param  command [description]
- * @return         0
-*/
-int parse_command(char *buf, struct command_t *command) {
+ * Split one stage of an already substituted line into words, recursing for
+ * the stages after a pipe
+ */
+static int parse_words(char *buf, struct command_t *command) {
 	const char *splitters = " \t"; // split at whitespace
 	int index, len;
 	len = strlen(buf);
@@ -119,11 +122,6 @@ int parse_command(char *buf, struct command_t *command) {
 		buf[--len] = 0;
 	}
 
-	// auto-complete
-	if (len > 0 && buf[len - 1] == '?') {
-		command->auto_complete = true;
-	}
-
 	// background
 	if (len > 0 && buf[len - 1] == '&') {
 		command->background = true;
@@ -136,21 +134,21 @@ int parse_command(char *buf, struct command_t *command) {
 	} else {
 		command->name = (char *)malloc(strlen(pch) + 1);
 		strcpy(command->name, pch);
+		subst_restore(command->name);
 	}
 
 	command->args = (char **)malloc(sizeof(char *));
 
-	int redirect_index;
+	struct redirect redirect;
 	int arg_index = 0;
-	char temp_buf[1024], *arg;
+	char *arg;
 
 	while (1) {
 		// tokenize input on splitters
 		pch = strtok(NULL, splitters);
 		if (!pch)
 			break;
-		arg = temp_buf;
-		strcpy(arg, pch);
+		arg = pch; // words are changed in place, they can be of any length
 		len = strlen(arg);
 
 		// empty arg, go for next
@@ -176,14 +174,14 @@ int parse_command(char *buf, struct command_t *command) {
 
 		// piping to another command
 		if (strcmp(arg, "|") == 0) {
-			struct command_t *c = malloc(sizeof(struct command_t));
+			struct command_t *c = calloc(1, sizeof(struct command_t));
 			int l = strlen(pch);
 			pch[l] = splitters[0]; // restore strtok termination
 			index = 1;
 			while (pch[index] == ' ' || pch[index] == '\t')
 				index++; // skip whitespaces
 
-			parse_command(pch + index, c);
+			parse_words(pch + index, c);
 			pch[l] = 0; // put back strtok termination
 			command->next = c;
 			continue;
@@ -195,36 +193,63 @@ int parse_command(char *buf, struct command_t *command) {
 			continue;
 		}
 
-		// handle input redirection
-		redirect_index = -1;
-		if (arg[0] == '<') {
-			redirect_index = 0;
-		}
-
-		if (arg[0] == '>') {
-			if (len > 1 && arg[1] == '>') {
-				redirect_index = 2;
-				arg++;
-				len--;
-			} else {
-				redirect_index = 1;
+		// handle redirections, kept in command line order:
+		// <, >, >>, n>, n>>, n>&m, &>, &>>, <<<
+		if (redirect_parse(arg, &redirect)) {
+			if (redirect_needs_target(&redirect)) {
+				pch = strtok(NULL, splitters); // target is the next word
+				if (pch == NULL || strcmp(pch, "|") == 0) {
+					fprintf(stderr,
+							"-%s: syntax error near unexpected token `%s'\n",
+							sysname, pch ? pch : "newline");
+					command->name[0] = 0; // don't run a half parsed line
+					break;
+				}
+				redirect.target = strdup(pch);
 			}
-		}
-
-		if (redirect_index != -1) {
-			command->redirects[redirect_index] = malloc(len);
-			strcpy(command->redirects[redirect_index], arg + 1);
+			len = redirect.target ? strlen(redirect.target) : 0;
+			if (len > 2 && ((redirect.target[0] == '"' &&
+							 redirect.target[len - 1] == '"') ||
+							(redirect.target[0] == '\'' &&
+							 redirect.target[len - 1] == '\''))) {
+				memmove(redirect.target, redirect.target + 1, len - 2);
+				redirect.target[len - 2] = 0;
+			}
+			if (redirect.target)
+				subst_restore(redirect.target);
+			command->redirects =
+				realloc(command->redirects, sizeof(struct redirect) *
+												(command->redirect_count + 1));
+			command->redirects[command->redirect_count++] = redirect;
 			continue;
 		}
 
 		// normal arguments
-		if (len > 2 &&
-			((arg[0] == '"' && arg[len - 1] == '"') ||
-			 (arg[0] == '\'' && arg[len - 1] == '\''))) // quote wrapped arg
-		{
+		bool quote_wrapped =
+			len > 2 && ((arg[0] == '"' && arg[len - 1] == '"') ||
+						(arg[0] == '\'' && arg[len - 1] == '\''));
+		if (quote_wrapped) {
 			arg[--len] = 0;
 			arg++;
 		}
+		subst_restore(arg);
+		if (!quote_wrapped && expand_has_magic(arg)) {
+			// unquoted patterns expand to the matching paths, or stay as
+			// they are when nothing matches
+			struct expand_result matches = { 0 };
+			if (line_cache == NULL)
+				line_cache = expand_cache_new();
+			if (expand_glob(line_cache, arg, &matches) > 0) {
+				command->args =
+					realloc(command->args,
+							sizeof(char *) * (arg_index + matches.count));
+				memcpy(command->args + arg_index, matches.paths,
+					   sizeof(char *) * matches.count);
+				arg_index += matches.count;
+				free(matches.paths);
+				continue;
+			}
+		}
 
 		command->args =
 			(char **)realloc(command->args, sizeof(char *) * (arg_index + 1));
@@ -252,6 +277,38 @@ int parse_command(char *buf, struct command_t *command) {
 	return 0;
 }
 
+/**
+ * Parse a command string into a command struct
+ * @param  buf     [description]
+ * @param  command [description]
+ * @return         0
+*/
+int parse_command(char *buf, struct command_t *command) {
+	// substitutions run once for the whole line, before it is split into
+	// words and stages; a syntax error leaves an empty command
+	char empty[1] = "";
+	char *line = subst_expand(buf, command);
+	parse_words(line ? line : empty, command);
+	expand_cache_free(line_cache); // listings are only good for one line
+	line_cache = NULL;
+	free(line);
+	return 0;
+}
+
+/**
+ * Drop the first word of a command, making the next one the command name.
+ * Used for prefixes like time.
+ * @param command command with at least one argument
+ */
+void shift_command(struct command_t *command) {
+	free(command->name);
+	free(command->args[0]);
+	command->name = strdup(command->args[1]);
+	for (int i = 0; i < command->arg_count - 1; i++)
+		command->args[i] = command->args[i + 1];
+	command->arg_count--;
+}
+
 void prompt_backspace(void) {
 	putchar(8); // go back 1
 	putchar(' '); // write empty over
@@ -266,24 +323,31 @@ void prompt_backspace(void) {
  */
 int prompt(struct command_t *command) {
 	size_t index = 0;
-	char c;
+	int c;
 	char buf[4096];
 	static char oldbuf[4096];
 
-	// tcgetattr gets the parameters of the current terminal
-	// STDIN_FILENO will tell tcgetattr that it should write the settings
-	// of stdin to oldt
+	// the terminal settings only need to be read once; when stdin is not a
+	// terminal (scripted input) the termios calls are skipped altogether
+	static bool termios_ready = false, is_tty = false;
 	static struct termios backup_termios, new_termios;
-	tcgetattr(STDIN_FILENO, &backup_termios);
-	new_termios = backup_termios;
-	// ICANON normally takes care that one line at a time will be processed
-	// that means it will return if it sees a "\n" or an EOF or an EOL
-	new_termios.c_lflag &=
-		~(ICANON |
-		  ECHO); // Also disable automatic echo. We manually echo each char.
+	if (!termios_ready) {
+		termios_ready = true;
+		// tcgetattr gets the parameters of the current terminal
+		// STDIN_FILENO will tell tcgetattr that it should write the settings
+		// of stdin to oldt
+		is_tty = tcgetattr(STDIN_FILENO, &backup_termios) == 0;
+		new_termios = backup_termios;
+		// ICANON normally takes care that one line at a time will be processed
+		// that means it will return if it sees a "\n" or an EOF or an EOL
+		new_termios.c_lflag &=
+			~(ICANON |
+			  ECHO); // Also disable automatic echo. We manually echo each char.
+	}
 	// Those new settings will be set to STDIN
 	// TCSANOW tells tcsetattr to change attributes immediately.
-	tcsetattr(STDIN_FILENO, TCSANOW, &new_termios);
+	if (is_tty)
+		tcsetattr(STDIN_FILENO, TCSANOW, &new_termios);
 
 	show_prompt();
 	buf[0] = 0;
@@ -294,8 +358,13 @@ int prompt(struct command_t *command) {
 
 		// handle tab
 		if (c == 9) {
-			buf[index++] = '?'; // autocomplete
-			break;
+			if (complete_line(buf, &index, sizeof(buf))) {
+				// a candidate list was printed, redraw the line below it
+				buf[index] = 0;
+				show_prompt();
+				printf("%s", buf);
+			}
+			continue;
 		}
 
 		// handle backspace
@@ -307,18 +376,26 @@ int prompt(struct command_t *command) {
 			continue;
 		}
 
-		if (c == 27 || c == 91 || c == 66 || c == 67 || c == 68) {
-			continue;
-		}
+		// escape sequences: only the up arrow (ESC [ A) is used, the rest
+		// (other arrows, Home/End, ...) is read in full and dropped
+		if (c == 27) {
+			c = getchar();
+			if (c != '[' && c != 'O')
+				continue;
+			do
+				c = getchar();
+			while ((c >= '0' && c <= '9') || c == ';');
+			if (c != 'A')
+				continue;
 
-		// up arrow
-		if (c == 65) {
+			// up arrow
 			while (index > 0) {
 				prompt_backspace();
 				index--;
 			}
 
 			char tmpbuf[4096];
+			buf[index] = 0;
 			printf("%s", oldbuf);
 			strcpy(tmpbuf, buf);
 			strcpy(buf, oldbuf);
@@ -327,14 +404,25 @@ int prompt(struct command_t *command) {
 			continue;
 		}
 
-		putchar(c); // echo the character
+		if (c == EOF) {
+			if (index == 0)
+				c = 4; // end of input on an empty line acts as Ctrl+D
+			else
+				c = '\n';
+		}
+
+		if (c != 4)
+			putchar(c); // echo the character
 		buf[index++] = c;
 		if (index >= sizeof(buf) - 1)
 			break;
 		if (c == '\n') // enter key
 			break;
-		if (c == 4) // Ctrl+D
+		if (c == 4 || c == EOF) { // Ctrl+D
+			if (is_tty)
+				tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
 			return EXIT;
+		}
 	}
 
 	// trim newline from the end
@@ -347,630 +435,461 @@ int prompt(struct command_t *command) {
 
 	strcpy(oldbuf, buf);
 
+	long long span = trace_begin();
 	parse_command(buf, command);
+	trace_end(TRACE_PARSE, NULL, span);
 
 	// print_command(command); // DEBUG: uncomment for debugging
 
 	// restore the old settings
-	tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
+	if (is_tty)
+		tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
 	return SUCCESS;
 }
 
-int process_command(struct command_t *command);
-
-int main(void) {
-	while (1) {
-		struct command_t *command = malloc(sizeof(struct command_t));
+// exit status of the last foreground command, shown by \? in the prompt
+int last_status = 0;
 
-		// set all bytes to 0
-		memset(command, 0, sizeof(struct command_t));
+// background children that have not been reaped yet
+static pid_t *bg_jobs = NULL;
+static int bg_job_count = 0;
 
-		int code;
-		code = prompt(command);
-		if (code == EXIT) {
-			break;
-		}
+void add_background_job(pid_t pid) {
+	bg_jobs = realloc(bg_jobs, sizeof(pid_t) * (bg_job_count + 1));
+	bg_jobs[bg_job_count++] = pid;
+	printf("[%d] %d\n", bg_job_count, pid);
+}
 
-		code = process_command(command);
-		if (code == EXIT) {
-			break;
+/**
+ * Drop a background job that was reaped elsewhere
+ */
+void forget_background_job(pid_t pid) {
+	for (int i = 0; i < bg_job_count; i++) {
+		if (bg_jobs[i] == pid) {
+			bg_jobs[i] = bg_jobs[--bg_job_count];
+			return;
 		}
-
-		free_command(command);
 	}
-
-	printf("\n");
-	return 0;
-}
-void removeSpaces(char *str) {
-	int count = 0;
-	for (int i = 0; str[i]; i++)
-		if (str[i] != ' ' && str[i] != '\t')
-			str[count++] = str[i]; // here count is incremented
-	str[count] = '\0';
 }
-void lineCount(int counts[4][4], char *fileName) {
-	FILE *fp = fopen(fileName, "r");
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t read;
-	char *ext = strrchr(fileName, '.');
-
-	// Check if file exists
-	if (fp == NULL) {
-		printf("Could not open file %s", fileName);
-		return;
-	}
-	bool command = false;
-	while ((read = getline(&line, &len, fp)) != -1) {
-		removeSpaces(line);
-		if (ext) {
-			if (strcmp(ext, ".py") == 0) { //PYTHON.
-				if (strlen(line) == 1) {
-					counts[0][1] += 1;
-				} else if (line[0] == '\'' && line[1] == '\'' &&
-						   line[2] == '\'') {
-					command = true;
-					counts[0][2] += 1;
-					if (strstr(line, "\'\'\'") != NULL) {
-						command = false;
-					}
-				} else if (command) {
-					counts[0][2] += 1;
-					if (strstr(line, "\'\'\'") != NULL) {
-						command = false;
-					}
-				} else if (line[0] == '\"' && line[1] == '\"' &&
-						   line[2] == '\"') {
-					command = true;
-					counts[0][2] += 1;
-					if (strstr(line, "\"\"\"") != NULL) {
-						command = false;
-					}
-				} else if (command) {
-					counts[0][2] += 1;
-					if (strstr(line, "\"\"\"") != NULL) {
-						command = false;
-					}
-				} else if (line[0] == '#') {
-					counts[0][2] += 1;
-				} else {
-					counts[0][0] += 1;
-				}
-
-			} else if (strcmp(ext, ".cpp") == 0) { //C++.
-				if (strlen(line) == 1) {
-					counts[1][1] += 1;
-				} else if (line[0] == '/' && line[1] == '*') {
-					command = true;
-					counts[1][2] += 1;
-					if (strstr(line, "*/") != NULL) {
-						command = false;
-					}
-				} else if (command) {
-					counts[1][2] += 1;
-					if (strstr(line, "*/") != NULL) {
-						command = false;
-					}
-				} else if (line[0] == '/' && line[1] == '/') {
-					counts[1][2] += 1;
-				} else {
-					counts[1][0] += 1;
-				}
 
-			} else if (strcmp(ext, ".c") == 0) { //C.
-				if (strlen(line) == 1) {
-					counts[2][1] += 1;
-				} else if (line[0] == '/' && line[1] == '*') {
-					command = true;
-					counts[2][2] += 1;
-					if (strstr(line, "*/") != NULL) {
-						command = false;
-					}
-				} else if (command) {
-					counts[2][2] += 1;
-					if (strstr(line, "*/") != NULL) {
-						command = false;
-					}
-				} else if (line[0] == '/' && line[1] == '/') {
-					counts[2][2] += 1;
-				} else {
-					counts[2][0] += 1;
-				}
-			} else {
-				if (strlen(line) == 1) {
-					counts[3][1] += 1;
-				} else {
-					counts[3][0] += 1;
-				}
-			}
-		} else {
-			if (strlen(line) == 1) {
-				counts[3][1] += 1;
-			} else {
-				counts[3][0] += 1;
-			}
+/**
+ * Reap finished background jobs without blocking
+ * @return number of jobs still running
+ */
+int reap_background_jobs(void) {
+	int i = 0;
+	while (i < bg_job_count) {
+		int status;
+		pid_t r = waitpid(bg_jobs[i], &status, WNOHANG);
+		if (r == bg_jobs[i] || (r == -1 && errno == ECHILD)) {
+			bg_jobs[i] = bg_jobs[--bg_job_count];
+			continue;
 		}
+		i++;
 	}
-
-	// Close the file
-	fclose(fp);
-	return;
+	return bg_job_count;
 }
-void listFiles(int *ignored_files, int *processed_files, char *dirname,
-			   int counts[4][4]) {
-	DIR *dir = opendir(dirname);
-	if (dir == NULL) {
-		printf("No folder found!\n");
-		return;
-	}
-	struct dirent *ent;
-	ent = readdir(dir);
-	while (ent != NULL) {
-		char name[256];
-		strcpy(name, ent->d_name);
-		char *ext = strrchr(name, '.');
-		if (ent->d_type == 4 && strcmp(name, ".") != 0 &&
-			strcmp(name, "..") != 0 && name[0] != '.') {
-			char path[512];
-			sprintf(path, "%s/%s", dirname, ent->d_name);
-			listFiles(ignored_files, processed_files, path, counts);
-		} else if (name[0] != '.') {
-			*processed_files += 1;
-			if (ext) {
-				if (strcmp(ext, ".py") == 0) {
-					counts[0][3] += 1;
-				} else if (strcmp(ext, ".cpp") == 0) {
-					counts[1][3] += 1;
-				} else if (strcmp(ext, ".c") == 0) {
-					counts[2][3] += 1;
-				} else {
-					counts[3][3] += 1;
-				}
-			} else {
-				counts[3][3] += 1;
-			}
-			char fileName[512];
-			sprintf(fileName, "%s/%s", dirname, ent->d_name);
-			lineCount(counts, fileName);
-		} else {
-			if (strcmp(name, "..") != 0 && strcmp(name, ".") != 0) {
-				*ignored_files += 1;
-			}
-		}
-		ent = readdir(dir);
-	}
-	closedir(dir);
+
+int background_job_count(void) {
+	return bg_job_count;
 }
-int process_command(struct command_t *command) {
-	int r;
 
-	if (strcmp(command->name, "") == 0) {
-		return SUCCESS;
-	}
+/**
+ * Exec a command in the current (child) process, resolving it through PATH.
+ * Never returns.
+ * @param command command to run
+ */
+void exec_command(struct command_t *command) {
+	/// This shows how to do exec with environ (but is not available on MacOs)
+	// extern char** environ; // environment variables
+	// execvpe(command->name, command->args, environ); // exec+args+path+environ
 
-	if (strcmp(command->name, "exit") == 0) {
-		return EXIT;
-	}
+	/// This shows how to do exec with auto-path resolve
+	// add a NULL argument to the end of args, and the name to the beginning
+	// as required by exec
 
-	if (strcmp(command->name, "cd") == 0) {
-		if (command->arg_count > 0) {
-			r = chdir(command->args[1]); // Changed to first argument
-			if (r == -1) {
-				printf("-%s: %s: %s\n", sysname, command->name,
-					   strerror(errno));
-			}
+	// TODO: do your own exec with path resolving using execv()
+	// do so by replacing the execvp call below
 
-			char cwdpath[256];
-			char *home_dir = getenv("HOME");
-			char full_path[256];
-			sprintf(full_path, "%s/%s", home_dir, "cdhistory.txt");
-			FILE *cdhistory = fopen(full_path, "r+");
-			char history[10][256];
-			char new_history[11][256];
-			int i = 0;
-
-			if (cdhistory != NULL) {
-				while (fscanf(cdhistory, "%s\n", history[i]) !=
-					   EOF) { //getting cd history from saved file into an array
-					i++;
-				}
-				fclose(cdhistory);
-			}
+	//execvp(command->name, command->args); // exec+args+path
 
-			getcwd(cwdpath, sizeof(cwdpath));
-			int curr_index = 0;
-			int ex_index = 0;
-			while (ex_index < i) {
-				if (strcmp(history[ex_index], cwdpath) != 0) {
-					strcpy(
-						new_history[curr_index],
-						history[ex_index]); //copying unique paths into new array
-					curr_index++; //and if the new path already exists in history
-				} //we don't copy it so we can add it to the end of the file
-				ex_index++; //making it the latest unique path entry
-			}
-			strcpy(new_history[curr_index], cwdpath);
-			curr_index++;
-			cdhistory = fopen(full_path, "w");
-			if (curr_index ==
-				11) { //checking if we exceeded the 10 unique path limit
-				for (int c = 0; c < 10; c++) { //then take action accordingly
-					//printf("%s\n", new_history[c+1]);
-					fprintf(cdhistory, "%s\n",
-							new_history[c + 1]); //deleting the oldest path
-				}
-			} else {
-				for (int c = 0; c < curr_index; c++) {
-					//printf("%s\n", new_history[c]);
-					fprintf(cdhistory, "%s\n", new_history[c]);
-				}
-			}
-			fclose(cdhistory);
-			return SUCCESS;
-		}
-	}
+	char *arr[command->arg_count + 1];
 
-	if (strcmp(command->name, "cdh") == 0) {
-		char *home_dir = getenv("HOME");
-		char full_path[256];
-		sprintf(full_path, "%s/%s", home_dir, "cdhistory.txt");
-		char history[10][256];
-		FILE *cdhistory = fopen(full_path, "r");
-		char new_history[10][256];
+	for (int i = 0; i < command->arg_count; i++) {
+		arr[i] = command->args[i];
+	}
 
-		if (cdhistory == NULL) {
-			return SUCCESS;
-		}
+	arr[command->arg_count] = NULL;
+	long long span = trace_begin();
+	char *shellPath = getenv("PATH"); //getting PATH variable
+	char pathcpy[1024];
+	strcpy(
+		pathcpy,
+		shellPath); //copying the original variable because of strtok, so we can use the adress again after strtok destroys given address var.
+	char path[1024];
+	char e_path[1024] = "";
+	char *token = strtok(pathcpy, ":"); //tokenizing the path - first path
+
+	const char *cached = path_cache_lookup(shellPath, command->name);
+	if (strchr(command->name, '/') != NULL) {
+		token = NULL; // explicit path, no PATH lookup
+		snprintf(e_path, sizeof(e_path), "%s", command->name);
+	} else if (cached != NULL) {
+		token = NULL; // indexed by a parent that forks many lookups
+		snprintf(e_path, sizeof(e_path), "%s", cached);
+	}
 
-		char s = 'a';
-		int i = 0;
-		while (fscanf(cdhistory, "%s\n", history[i]) !=
-			   EOF) { //getting history into array
-			i++;
+	while (token != NULL) {
+		sprintf(path, "%s/%s", token, command->name);
+		if (access(path, F_OK) == 0) {
+			strcpy(
+				e_path,
+				path); //if found a working path for the given command, copy it to execute command in found path later
+			break;
 		}
-		fclose(cdhistory);
-		int j = i;
-		for (int k = 0; k < j;
-			 k++) { //printing history as seen in the given example
-			printf("%c  %d)  %s\n", s + i - 1, i, history[k]);
-			i--;
+		token = strtok(
+			0, ":"); //continuing to tokenize other paths in PATH variable
+		if (token == NULL) {
+			break;
 		}
+	}
+	trace_end(TRACE_PATH, NULL, span);
 
-		char choice = 'a';
-		int choiceNum = 0;
-		printf("Select directory by letter or number: ");
-		scanf("%c", &choice);
+	span = trace_begin();
+	if (redirect_apply(command->redirects, command->redirect_count) == -1)
+		_exit(1); // the error is already printed
+	trace_end(TRACE_REDIRECT, NULL, span);
 
-		if (isdigit(choice) !=
-			0) { //converting choice into int to be able to index array
-			choiceNum = choice - '0';
-		} else {
-			choiceNum = choice - 'a' + 1;
-		}
+	execv(e_path, arr);
+	printf("-%s: %s: command not found\n", sysname, command->name);
+	fflush(stdout);
+	_exit(127); // exit() would rewind the stdin offset shared with the shell
+}
 
-		choiceNum = j - choiceNum;
-		r = chdir(history[choiceNum]); //changing dir
-		if (r == -1) {
-			printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
-		}
+/*
+ * One stage of a running pipeline. Builtins that are safe to share the
+ * shell's address space run on a thread, everything else is forked.
+ */
+struct stage {
+	struct command_t *command;
+	const struct launch_options *launch; // from a run prefix
+	int index; // position in the pipeline
+	const struct builtin *builtin; // set for stages run on a thread
+	pid_t pid;
+	pthread_t thread;
+	int in_fd, out_fd;
+	bool started;
+	bool done;
+	int status; // wait status
+	long long start_ns, wall_ns;
+	struct rusage usage;
+};
 
-		int curr_index = 0;
-		int ex_index = 0;
-		while (ex_index <
-			   j) //refreshing history.txt according to the latest changed dir
-		{
-			if (strcmp(history[ex_index], history[choiceNum]) != 0) {
-				strcpy(new_history[curr_index], history[ex_index]);
-				curr_index++;
-			}
-			ex_index++;
-		}
-		strcpy(new_history[curr_index], history[choiceNum]);
-		curr_index++;
+static void close_stage_fds(struct stage *stage) {
+	if (stage->in_fd > STDERR_FILENO)
+		close(stage->in_fd);
+	if (stage->out_fd > STDERR_FILENO)
+		close(stage->out_fd);
+	stage->in_fd = STDIN_FILENO;
+	stage->out_fd = STDOUT_FILENO;
+}
 
-		cdhistory = fopen(full_path, "w");
-		for (int c = 0; c < curr_index; c++) {
-			//printf("%s\n", new_history[c]);
-			fprintf(cdhistory, "%s\n", new_history[c]);
-		}
-		fclose(cdhistory);
+static void *builtin_thread(void *arg) {
+	struct stage *stage = arg;
+	int status = builtin_run(stage->builtin, stage->command->args,
+							 stage->in_fd, stage->out_fd);
+	getrusage(RUSAGE_THREAD, &stage->usage);
+	stage->wall_ns = timing_now_ns() - stage->start_ns;
+	stage->status = W_EXITCODE(status & 0xff, 0);
+	// closing our pipe ends is what lets the neighbouring stages finish
+	close_stage_fds(stage);
+	return NULL;
+}
 
-		return SUCCESS;
+static int collect_cloexec_fd(const char *name, unsigned char type,
+							  void *arg) {
+	(void)type;
+	int *fds = arg;
+	int fd = atoi(name);
+	int flags = fcntl(fd, F_GETFD);
+	if (fd > STDERR_FILENO && flags != -1 && (flags & FD_CLOEXEC) &&
+		fds[0] < CLOEXEC_FDS_MAX)
+		fds[++fds[0]] = fd;
+	return 0;
+}
+
+/**
+ * Close what an exec would, for forked builtins that never exec: the
+ * pipes of the other stages are close-on-exec, while /dev/fd/N of process
+ * substitutions has to stay
+ */
+static void close_cloexec_fds(void) {
+	int fds[CLOEXEC_FDS_MAX + 1] = { 0 }; // count, then the fds
+	do {
+		fds[0] = 0;
+		if (dirscan(AT_FDCWD, "/proc/self/fd", collect_cloexec_fd, fds) ==
+			-1) {
+			close_range(STDERR_FILENO + 1, ~0U, 0); // no /proc, close all
+			return;
+		}
+		for (int i = 1; i <= fds[0]; i++)
+			close(fds[i]);
+	} while (fds[0] == CLOEXEC_FDS_MAX);
+}
+
+/**
+ * Body of a forked stage: wire up stdin/stdout and run the command.
+ * Never returns.
+ */
+static void run_forked_stage(struct stage *stage) {
+	signal(SIGPIPE, SIG_DFL); // ignored by the shell itself
+	if (stage->launch != NULL && launch_apply(stage->launch, stage->index) == -1)
+		_exit(126);
+	if (stage->in_fd != STDIN_FILENO)
+		dup2(stage->in_fd, STDIN_FILENO);
+	if (stage->out_fd != STDOUT_FILENO)
+		dup2(stage->out_fd, STDOUT_FILENO);
+
+	const struct builtin *builtin = builtin_for(stage->command->args);
+	if (builtin == NULL) {
+		// the pipe ends themselves are close-on-exec, only the
+		// duplicates on stdin/stdout survive into the command
+		exec_command(stage->command);
 	}
 
-	if (strcmp(command->name, "roll") == 0) {
-		if (command->arg_count != 3) {
-			fprintf(stderr, "Wrong argument count!");
+	if (redirect_apply(stage->command->redirects,
+					   stage->command->redirect_count) == -1)
+		_exit(1);
+	// there is no exec to drop the pipes of the other stages, and holding
+	// a write end open would keep a reader waiting for EOF
+	close_cloexec_fds();
+	// what the shell buffered from its stdin is not this stage's input
+	__fpurge(stdin);
+	int status = builtin_run(builtin, stage->command->args, STDIN_FILENO,
+							 STDOUT_FILENO);
+	fflush(stdout);
+	_exit(status);
+}
+
+/**
+ * Run a command line. A lone builtin runs inside the shell; otherwise every
+ * stage of the pipeline is started with its stdin/stdout connected, builtins
+ * on threads when they allow it, and the shell waits for all of them,
+ * collecting per-stage rusage through wait4
+ * @param  command first stage of the pipeline
+ * @param  run     accounting filled with one entry per stage
+ * @return         SUCCESS
+ */
+int run_pipeline(struct command_t *command, struct timing_run *run) {
+	const struct builtin *builtin = builtin_for(command->args);
+	if (builtin != NULL && command->next == NULL && !command->background &&
+		command->launch == NULL) {
+		// redirect the shell's own fds around the builtin, then put them back
+		struct redirect_saved *saved;
+		fflush(stdout); // keep the order of buffered and fd output
+		if (command->redirect_count == 0) {
+			last_status = builtin_run(builtin, command->args, STDIN_FILENO,
+									  STDOUT_FILENO);
 			return SUCCESS;
-		} else {
-			int rollCount = 1;
-			int diceSize = 1;
-			char rollArgs[10];
-			strcpy(rollArgs, command->args[1]);
-			char *ptr;
-			int first_num = strtol(rollArgs, &ptr, 10);
-			if (first_num != 0 && ptr[0] == 'd') {
-				char *rest;
-				rollCount = first_num;
-				diceSize = strtol(&ptr[1], &rest, 10);
-				int total = 0;
-				int nums[rollCount];
-				for (int i = 0; i < rollCount; i++) {
-					nums[i] = (rand() % diceSize) + 1;
-					total += nums[i];
-				}
-				printf("Rolled %d (", total);
-				for (int i = 0; i < rollCount - 1; i++) {
-					printf("%d + ", nums[i]);
-				}
-				printf("%d)\n", nums[rollCount - 1]);
-				return SUCCESS;
-			} else if (ptr[0] == 'd') {
-				char *rest;
-				diceSize = strtol(&ptr[1], &rest, 10);
-				printf("Rolled %d \n", (rand() % diceSize) + 1);
-				return SUCCESS;
-			} else {
-				printf("Error in argument.\n");
-				return SUCCESS;
-			}
-			printf("rollcount: %d, dicesize: %d\n", rollCount, diceSize);
 		}
-	}
-	if (strcmp(command->name, "cloc") == 0) {
-		char path[512];
-		char cloc_path[1024];
-		getcwd(path, sizeof(path));
-		sprintf(cloc_path, "%s/%s", path, command->args[1]);
-		int processed_files = 0;
-		int ignored_files = 0;
-		int counts[4][4] = {
-			{ 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }
-		};
-		//2D counts array has 4 int-arr for python,c++,c and txt(all other formats.)
-		// counts[x][0] = total #of lines of code.
-		// counts[x][1] = total #of blank lines
-		// counts[x][2] = total #of command lines.
-		// counts[x][3] = total #of files for that type.
-		listFiles(&ignored_files, &processed_files, cloc_path, counts);
-		printf("Total Number of files found: %d\n",
-			   ignored_files + processed_files);
-		printf("Number of ignored files: %d\n", ignored_files);
-		printf("Number of processed files: %d\n", processed_files);
-		printf("Python; %d files, %d blank, %d command, %d code lines.\n",
-			   counts[0][3], counts[0][1], counts[0][2], counts[0][0]);
-		printf("Cpp;    %d files, %d blank, %d command, %d code lines.\n",
-			   counts[1][3], counts[1][1], counts[1][2], counts[1][0]);
-		printf("C;      %d files, %d blank, %d command, %d code lines.\n",
-			   counts[2][3], counts[2][1], counts[2][2], counts[2][0]);
-		printf("Txt;    %d files, %d blank, %d command, %d code lines.\n",
-			   counts[3][3], counts[3][1], counts[3][2], counts[3][0]);
-		int total_counts[4] = { 0, 0, 0, 0 };
-		for (int i = 0; i < 4; i++) {
-			for (int j = 0; j < 4; j++) {
-				total_counts[j] += counts[i][j];
+		int saved_count = redirect_save(command->redirects,
+										command->redirect_count, &saved);
+		if (redirect_apply(command->redirects, command->redirect_count) == 0) {
+			// what stdio buffered from the shell's stdin belongs to the
+			// prompt, a redirected stdin is read from an fd of its own
+			int in_fd = STDIN_FILENO;
+			for (int i = 0; i < command->redirect_count; i++) {
+				if (command->redirects[i].fd == STDIN_FILENO &&
+					in_fd == STDIN_FILENO)
+					in_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC,
+								  STDERR_FILENO + 1);
 			}
+			last_status = builtin_run(builtin, command->args,
+									  in_fd == -1 ? STDIN_FILENO : in_fd,
+									  STDOUT_FILENO);
+			if (in_fd > STDERR_FILENO)
+				close(in_fd);
+		} else {
+			last_status = 1;
 		}
-		printf("Total;  %d files, %d blank, %d command, %d code lines.\n",
-			   total_counts[3], total_counts[1], total_counts[2],
-			   total_counts[0]);
+		redirect_restore(saved, saved_count);
 		return SUCCESS;
 	}
 
-	if (strcmp(command->name, "rename") == 0 ||
-		strcmp(command->name, "mvsf") == 0) {
-		int status = 0;
-		char path[256];
-		char oldfilename[512];
-		char newfilename[512];
+	int stage_count = 0;
+	for (struct command_t *c = command; c; c = c->next)
+		stage_count++;
 
-		getcwd(path, sizeof(path));
-		sprintf(oldfilename, "%s/%s", path, command->args[1]);
-		sprintf(newfilename, "%s/%s", path, command->args[2]);
+	struct stage *stages = calloc(stage_count, sizeof(struct stage));
+	int launched = 0;
+	int in_fd = STDIN_FILENO;
 
-		if (command->arg_count != 4) {
-			fprintf(
-				stderr,
-				"Wrong arguments!\nUsage for mvsf(move to subfolder): mvsf <old file name> <new file namepath>\nUsage for rename: rename <old file name> <new file name>\n");
-			return SUCCESS;
-		} else {
-			status = rename(oldfilename, newfilename);
+	fflush(stdout); // don't let the children inherit pending output
+	for (struct command_t *c = command; c; c = c->next, launched++) {
+		struct stage *stage = &stages[launched];
+		int pipefd[2] = { -1, -1 };
+		if (c->next && pipe2(pipefd, O_CLOEXEC) == -1) {
+			fprintf(stderr, "-%s: pipe: %s\n", sysname, strerror(errno));
+			break;
 		}
 
-		if (status == 0) {
-			printf("File renamed/moved successfully.\n");
-			return SUCCESS;
-		} else {
-			printf("Failed to rename/move the file.\n");
-			return SUCCESS;
-		}
-	}
-	if (strcmp(command->name, "searchwords") == 0) {
-		char path[256];
-		char file[512];
-		char searched_word[256];
-		int word_count = 0;
-		getcwd(path, sizeof(path));
-		sprintf(file, "%s/%s", path, command->args[1]);
-		sprintf(searched_word, "%s", command->args[2]);
-		if (command->arg_count != 4) {
-			fprintf(
-				stderr,
-				"Wrong arguments! Usage for searchwords: searchwords <file name> <searched word>\n.");
-			return SUCCESS;
-		}
-		FILE *search_file = fopen(file, "r");
-		char word[1024];
-		if (search_file == NULL) {
-			printf("Couldn't opened the file.\n");
-			return SUCCESS;
-		}
-		while (fscanf(search_file, "%1023s", word) == 1) {
-			//puts(word);
-			if (strstr(word, searched_word) != 0) {
-				word_count += 1;
+		stage->command = c;
+		stage->launch = c->launch ? c->launch : command->launch;
+		stage->index = launched;
+		stage->in_fd = in_fd;
+		stage->out_fd = pipefd[1] != -1 ? pipefd[1] : STDOUT_FILENO;
+		in_fd = pipefd[0];
+
+		builtin = builtin_for(c->args);
+		if (builtin != NULL && (builtin->flags & BUILTIN_THREAD) &&
+			!command->background && stage->launch == NULL &&
+			!redirect_needs_process(c->redirects, c->redirect_count)) {
+			// started once everything is forked, so no child is forked
+			// while a builtin thread is running
+			stage->builtin = builtin;
+			if (redirect_apply_fds(c->redirects, c->redirect_count,
+								   &stage->in_fd, &stage->out_fd) == -1) {
+				close_stage_fds(stage);
+				stage->done = true;
+				stage->status = W_EXITCODE(1, 0);
 			}
+			continue;
 		}
-		fclose(search_file);
-		printf("%s found %d times in file %s\n", searched_word, word_count,
-			   command->args[1]);
-		return SUCCESS;
-	}
-	if (strcmp(command->name, "psvis") == 0) {
-		if (command->arg_count != 4) {
-			printf("Wrong arguments! Usage: psvis <pid> <png name>\n");
-			return SUCCESS;
-		}
-		int root_pid = atoi(command->args[1]);
-		char command_exec[512];
-		char word[256];
-		int count = 0;
-		system(
-			"sudo -S dmesg > deneme.txt"); //getting kernel modules info before inserting our module
-		system(
-			"wc -l deneme.txt > den.txt"); //getting line count of dmesg for later use of parsing
-		FILE *count_file = fopen("den.txt", "r");
-		fscanf(count_file, "%s%*[^\n]",
-			   word); //getting line count value to word variable
-		fclose(count_file);
-		count = atoi(word);
-		kill(root_pid, 0);
-		if (errno ==
-			ESRCH) { //checking if the given pid exists to prevent module crash
-			printf("Please enter a valid PID!\n");
-			return SUCCESS;
+
+		stage->start_ns = timing_now_ns();
+		pid_t pid = fork();
+		if (pid == 0)
+			run_forked_stage(stage);
+		trace_end(TRACE_FORK, NULL, stage->start_ns);
+		close_stage_fds(stage);
+
+		if (pid == -1) {
+			fprintf(stderr, "-%s: fork: %s\n", sysname, strerror(errno));
+			break;
 		}
-		sprintf(command_exec, "sudo -S insmod mymodule.ko pid=%d", root_pid);
-		system(command_exec);
-		system("sudo -S dmesg > deneme.txt");
-		sprintf(command_exec, "sed '1,%dd' deneme.txt > deneme2.txt",
-				count); //transfering new lines after insmod
-		system(command_exec);
-		system("sudo -S rmmod mymodule"); //removing module
-
-		FILE *dmesg =
-			fopen("deneme2.txt", "r"); //writing to .gv file to be drawn
-		FILE *write_file = fopen("deneme3.gv", "w");
-		fprintf(write_file, "digraph ProcessTree{\n");
-		char line[1024];
-		while (fgets(line, sizeof(line), dmesg)) {
-			char *p = strchr(line, '"');
-			fprintf(write_file, "%s", p);
+		stage->pid = pid;
+		stage->started = true;
+	}
+	if (in_fd != STDIN_FILENO)
+		close(in_fd);
+
+	for (int i = 0; i < launched; i++) {
+		struct stage *stage = &stages[i];
+		if (stage->builtin == NULL || stage->done)
+			continue;
+		stage->start_ns = timing_now_ns();
+		if (pthread_create(&stage->thread, NULL, builtin_thread, stage) != 0) {
+			fprintf(stderr, "-%s: %s: cannot start thread\n", sysname,
+					stage->command->name);
+			close_stage_fds(stage);
+			stage->done = true;
+			stage->status = W_EXITCODE(1, 0);
+			continue;
 		}
-		fprintf(write_file, "}\n");
-		fclose(dmesg);
-		fclose(write_file);
-		sprintf(
-			command_exec, "dot -Tpng deneme3.gv -o %s",
-			command->args[2]); //creating .png using graphviz with .gv source file
-		if (system(command_exec) != 0) {
-			printf("Please install graphviz packages!\n");
-			return SUCCESS;
+		stage->started = true;
+	}
+
+	if (command->background) { // don't wait, reaped before a later prompt
+		for (int i = 0; i < launched; i++) {
+			if (stages[i].started)
+				add_background_job(stages[i].pid);
 		}
+		free(stages);
 		return SUCCESS;
-		// Elimize saglik.
 	}
 
-	pid_t pid = fork();
-	// child
-	if (pid == 0) {
-		/// This shows how to do exec with environ (but is not available on MacOs)
-		// extern char** environ; // environment variables
-		// execvpe(command->name, command->args, environ); // exec+args+path+environ
-
-		/// This shows how to do exec with auto-path resolve
-		// add a NULL argument to the end of args, and the name to the beginning
-		// as required by exec
-
-		// TODO: do your own exec with path resolving using execv()
-		// do so by replacing the execvp call below
-
-		//execvp(command->name, command->args); // exec+args+path
-
-		char *arr[command->arg_count + 1];
-
-		for (int i = 0; i < command->arg_count; i++) {
-			arr[i] = command->args[i];
+	// reap in completion order so every stage gets its own wall time
+	long long span = trace_begin();
+	int remaining = 0;
+	for (int i = 0; i < launched; i++)
+		remaining += stages[i].started && stages[i].builtin == NULL;
+	while (remaining > 0) {
+		int status;
+		struct rusage usage;
+		pid_t pid = wait4(-1, &status, 0, &usage);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
 		}
 
-		arr[command->arg_count] = NULL;
-		char *shellPath = getenv("PATH"); //getting PATH variable
-		char pathcpy[1024];
-		strcpy(
-			pathcpy,
-			shellPath); //copying the original variable because of strtok, so we can use the adress again after strtok destroys given address var.
-		char path[1024];
-		char e_path[1024];
-		char *token = strtok(pathcpy, ":"); //tokenizing the path - first path
-
-		while (true) {
-			sprintf(path, "%s/%s", token, command->name);
-			if (access(path, F_OK) == 0) {
-				strcpy(
-					e_path,
-					path); //if found a working path for the given command, copy it to execute command in found path later
-				break;
-			}
-			token = strtok(
-				0, ":"); //continuing to tokenize other paths in PATH variable
-			if (token == NULL) {
-				break;
-			}
+		int i = 0;
+		while (i < launched && !(stages[i].builtin == NULL &&
+								 stages[i].started && stages[i].pid == pid))
+			i++;
+		if (i == launched) {
+			forget_background_job(pid); // a background job finished
+			continue;
 		}
-
-		if (command->redirects[0] !=
-			NULL) { //handling three cases of redirecting
-			int fd = open(command->redirects[0],
-						  O_RDONLY); //opening the given file on read mode
-			dup2(fd, STDIN_FILENO); //fd opened on desc. stdin
-			execv(
-				e_path,
-				arr); //executing wanted command and since fd is opened on stdin, we have successfully directed stdin to file opened on fd
-		} else if (command->redirects[1] != NULL) {
-			int fd = creat(command->redirects[1],
-						   0644); //creating/truncating given file
-			dup2(fd, STDOUT_FILENO); //fd file desc. opened on file desc. stdout
-			execv(
-				e_path,
-				arr); //executing wanted command and taking what is in on stdout desc. to file opened on fd desc.
-			exit(0);
-		} else if (command->redirects[2] != NULL) {
-			int fd;
-			if (access(command->redirects[2], F_OK) == 0) {
-				fd = open(command->redirects[2],
-						  O_WRONLY |
-							  O_APPEND); //opening the existing file to append
-			} else {
-				fd = creat(
-					command->redirects[2],
-					0644); //handling the appending case where given file does not exist and needs to be created
-			}
-			dup2(fd, STDOUT_FILENO); //fd desc. opened on file desc. stdout
-			execv(e_path,
-				  arr); //executing command with redirected to wanted file
+		remaining--;
+		stages[i].wall_ns = timing_now_ns() - stages[i].start_ns;
+		stages[i].usage = usage;
+		stages[i].status = status;
+		stages[i].done = true;
+	}
+	for (int i = 0; i < launched; i++) {
+		if (stages[i].builtin != NULL && stages[i].started) {
+			pthread_join(stages[i].thread, NULL);
+			stages[i].done = true;
 		}
+	}
+	trace_end(TRACE_WAIT, NULL, span);
 
-		if (command
-				->background) { //If background execute in newly created child process in background
-			pid_t pidBack = fork();
-			if (pidBack == 0) {
-				execv(path, arr);
-			}
-			exit(0);
+	for (int i = 0; i < launched; i++) {
+		if (stages[i].done) {
+			timing_add_stage(run, stages[i].command->name, stages[i].wall_ns,
+							 &stages[i].usage, stages[i].status);
 		}
-		execv(e_path, arr);
-		printf("-%s: %s: command not found\n", sysname, command->name);
-		exit(0);
+	}
+	if (launched == stage_count && stages[launched - 1].done) {
+		int status = stages[launched - 1].status;
+		last_status = WIFEXITED(status) ? WEXITSTATUS(status) :
+										  128 + WTERMSIG(status);
+	}
+	free(stages);
+	return SUCCESS;
+}
 
-	} else {
-		// TODO: implement background processes here
-		wait(0); // wait for child process to finish
+/**
+ * Run a command line, handling the time prefix
+ * @param  command parsed command line
+ * @return         SUCCESS, or EXIT when the shell should quit
+ */
+int process_command(struct command_t *command) {
+	if (strcmp(command->name, "") == 0) {
 		return SUCCESS;
 	}
 
-	// TODO: your implementation here
+	if (strcmp(command->name, "exit") == 0 && command->next == NULL) {
+		return EXIT;
+	}
 
-	printf("-%s: %s: command not found\n", sysname, command->name);
-	return UNKNOWN;
+	bool timed = timing_always;
+	if (strcmp(command->name, "time") == 0) {
+		if (command->arg_count <= 2) // nothing to time
+			return SUCCESS;
+		shift_command(command);
+		timed = true;
+	}
+
+	// run before the first stage covers the pipeline, before a later stage
+	// only that stage
+	for (struct command_t *c = command; c; c = c->next) {
+		if (strcmp(c->name, "run") != 0)
+			continue;
+		c->launch = launch_parse(c);
+		if (c->launch == NULL) {
+			last_status = 2;
+			return SUCCESS;
+		}
+	}
+
+	struct timing_run run;
+	timing_begin(&run);
+	int code = run_pipeline(command, &run);
+	timing_end(&run, command->name);
+	if (timed && !command->background)
+		timing_report(&run);
+	timing_free(&run);
+	return code;
 }
@@ -0,0 +1,54 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "redirect.h"
+
+struct launch_options;
+struct process_subst;
+
+struct timing_run;
+
+extern const char *sysname;
+
+// exit status of the last foreground command, shown by \? in the prompt
+extern int last_status;
+
+enum return_codes {
+	SUCCESS = 0,
+	EXIT = 1,
+	UNKNOWN = 2,
+};
+
+struct command_t {
+	char *name;
+	bool background;
+	int arg_count;
+	char **args;
+	struct redirect *redirects; // in command line order
+	int redirect_count;
+	struct launch_options *launch; // from a run prefix, NULL if none
+	struct process_subst *substs; // <(...) and >(...) of the whole line
+	int subst_count;
+	struct command_t *next; // for piping
+};
+
+void print_command(struct command_t *command);
+int free_command(struct command_t *command);
+int show_prompt(void);
+int parse_command(char *buf, struct command_t *command);
+void shift_command(struct command_t *command);
+int prompt(struct command_t *command);
+int process_command(struct command_t *command);
+
+void exec_command(struct command_t *command);
+int run_pipeline(struct command_t *command, struct timing_run *run);
+
+void add_background_job(pid_t pid);
+void forget_background_job(pid_t pid);
+int reap_background_jobs(void);
+int background_job_count(void);
+
+#endif
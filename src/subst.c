@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "subst.h"
+
+struct buffer {
+	char *data;
+	size_t len, cap;
+};
+
+static void buffer_add(struct buffer *buf, const char *data, size_t len) {
+	if (buf->len + len + 1 > buf->cap) {
+		while (buf->len + len + 1 > buf->cap)
+			buf->cap = buf->cap ? buf->cap * 2 : 256;
+		buf->data = realloc(buf->data, buf->cap);
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	buf->data[buf->len] = 0;
+}
+
+/**
+ * Run a command line in a child of the shell with one of its standard fds
+ * replaced. Never returns in the child.
+ * @param  text    command line
+ * @param  fd      fd for the child's stdin or stdout
+ * @param  to      STDIN_FILENO or STDOUT_FILENO
+ * @param  other   the shell's end of the same pipe
+ * @param  command line whose earlier substitutions the child must not hold
+ * @return         pid of the child, -1 on failure
+ */
+static pid_t run_with_fd(const char *text, int fd, int to, int other,
+						 struct command_t *command) {
+	fflush(stdout); // don't let the child inherit pending output
+	pid_t pid = fork();
+	if (pid != 0)
+		return pid;
+
+	// the child shell never execs, so close-on-exec doesn't help here: a
+	// pipe end left open would keep its reader from ever seeing EOF
+	signal(SIGPIPE, SIG_DFL); // ignored by the shell itself
+	dup2(fd, to);
+	close(fd);
+	close(other);
+	for (int i = 0; i < command->subst_count; i++)
+		close(command->substs[i].fd);
+	free(command->substs);
+	command->substs = NULL;
+	command->subst_count = 0;
+	struct command_t *inner = calloc(1, sizeof(struct command_t));
+	char *line = strdup(text);
+	parse_command(line, inner);
+	process_command(inner);
+	fflush(stdout);
+	_exit(last_status);
+}
+
+/*
+ * Characters the parser acts on, kept as the control characters 1 to 6
+ * while they are in the output of a $(...), so that the output is only
+ * split into words and never read as a redirect, pipe or quote
+ */
+static const char parser_chars[] = "<>|&'\"";
+
+/**
+ * $(text): the output of text, with trailing newlines dropped and the
+ * others turned into spaces so the words split as usual
+ */
+static int command_subst(const char *text, struct buffer *out,
+						 struct command_t *command) {
+	int pipefd[2];
+	if (pipe2(pipefd, O_CLOEXEC) == -1)
+		return -1;
+	pid_t pid =
+		run_with_fd(text, pipefd[1], STDOUT_FILENO, pipefd[0], command);
+	close(pipefd[1]);
+	if (pid == -1) {
+		close(pipefd[0]);
+		return -1;
+	}
+
+	size_t start = out->len;
+	char chunk[4096];
+	for (;;) {
+		ssize_t n = read(pipefd[0], chunk, sizeof(chunk));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		buffer_add(out, chunk, n);
+	}
+	close(pipefd[0]);
+	waitpid(pid, NULL, 0);
+
+	while (out->len > start && out->data[out->len - 1] == '\n')
+		out->data[--out->len] = 0;
+	for (size_t i = start; i < out->len; i++) {
+		unsigned char c = out->data[i];
+		const char *special = memchr(parser_chars, c, sizeof(parser_chars) - 1);
+		if (special != NULL)
+			out->data[i] = special - parser_chars + 1;
+		else if (c == '\n' || c < sizeof(parser_chars))
+			out->data[i] = ' '; // also NUL and what would read as the above
+	}
+	return 0;
+}
+
+/**
+ * <(text) or >(text): start text on one end of a pipe, the other end
+ * stays open in the shell, without close-on-exec, for the command to open
+ * as /dev/fd/N
+ */
+static int process_subst(const char *text, bool input, struct buffer *out,
+						 struct command_t *command) {
+	int pipefd[2];
+	if (pipe2(pipefd, O_CLOEXEC) == -1)
+		return -1;
+	int keep = input ? pipefd[0] : pipefd[1];
+	int give = input ? pipefd[1] : pipefd[0];
+	pid_t pid = run_with_fd(text, give, input ? STDOUT_FILENO : STDIN_FILENO,
+							keep, command);
+	close(give);
+	if (pid == -1) {
+		close(keep);
+		return -1;
+	}
+	fcntl(keep, F_SETFD, 0);
+
+	command->substs = realloc(command->substs, sizeof(struct process_subst) *
+												   (command->subst_count + 1));
+	command->substs[command->subst_count++] =
+		(struct process_subst){ keep, pid };
+
+	char path[32];
+	int len = snprintf(path, sizeof(path), "/dev/fd/%d", keep);
+	buffer_add(out, path, len);
+	return 0;
+}
+
+/**
+ * Find the ')' closing the '(' at open
+ * @return its index, -1 if there is none
+ */
+static long matching_paren(const char *line, size_t open) {
+	int depth = 0;
+	bool quoted = false;
+	for (size_t i = open; line[i]; i++) {
+		if (line[i] == '\'')
+			quoted = !quoted;
+		else if (quoted)
+			continue;
+		else if (line[i] == '(')
+			depth++;
+		else if (line[i] == ')' && --depth == 0)
+			return i;
+	}
+	return -1;
+}
+
+char *subst_expand(const char *line, struct command_t *command) {
+	struct buffer out = { 0 };
+	bool quoted = false;
+	buffer_add(&out, "", 0);
+
+	for (size_t i = 0; line[i];) {
+		char c = line[i];
+		bool word_start = i == 0 || line[i - 1] == ' ' || line[i - 1] == '\t';
+		int kind = 0; // '$', '<' or '>'
+		if (c == '\'')
+			quoted = !quoted;
+		else if (!quoted && line[i + 1] == '(' &&
+				 (c == '$' || ((c == '<' || c == '>') && word_start)))
+			kind = c;
+
+		if (kind == 0) {
+			buffer_add(&out, &line[i++], 1);
+			continue;
+		}
+
+		long end = matching_paren(line, i + 1);
+		if (end == -1) {
+			fprintf(stderr, "-%s: syntax error: unterminated `%c('\n",
+					sysname, kind);
+			free(out.data);
+			return NULL;
+		}
+		char *text = strndup(line + i + 2, end - i - 2);
+		int status = kind == '$' ?
+						 command_subst(text, &out, command) :
+						 process_subst(text, kind == '<', &out, command);
+		if (status == -1)
+			fprintf(stderr, "-%s: %s: %s\n", sysname, text, strerror(errno));
+		free(text);
+		i = end + 1;
+	}
+	return out.data;
+}
+
+void subst_restore(char *word) {
+	for (; *word; word++) {
+		if (*word > 0 && *word < (int)sizeof(parser_chars))
+			*word = parser_chars[*word - 1];
+	}
+}
+
+void subst_finish(struct command_t *command) {
+	for (int i = 0; i < command->subst_count; i++) {
+		close(command->substs[i].fd);
+		if (command->background)
+			add_background_job(command->substs[i].pid);
+		else
+			waitpid(command->substs[i].pid, NULL, 0);
+	}
+	free(command->substs);
+	command->substs = NULL;
+	command->subst_count = 0;
+}
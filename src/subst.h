@@ -0,0 +1,41 @@
+#ifndef SUBST_H
+#define SUBST_H
+
+#include <sys/types.h>
+
+struct command_t;
+
+/*
+ * A running <(...) or >(...): the shell's end of its pipe, passed to the
+ * command as /dev/fd/N, and the child on the other end
+ */
+struct process_subst {
+	int fd;
+	pid_t pid;
+};
+
+/**
+ * Replace every $(...) with the output of the command inside, and every
+ * <(...) and >(...) with a /dev/fd path connected to a running command.
+ * Nothing inside single quotes is replaced.
+ * @param  line    command line
+ * @param  command gets the process substitutions that were started
+ * @return         new command line to be freed, NULL after printing a
+ *                 syntax error
+ */
+char *subst_expand(const char *line, struct command_t *command);
+
+/**
+ * Turn the characters that came out of a $(...) back into themselves, once
+ * the parser is done deciding what the word is
+ * @param word word of a line returned by subst_expand, changed in place
+ */
+void subst_restore(char *word);
+
+/**
+ * Close the shell's ends of a command line's process substitutions and
+ * wait for them, or hand them to the job list for a background command
+ */
+void subst_finish(struct command_t *command);
+
+#endif
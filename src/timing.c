@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+bool timing_always = false;
+
+long long timing_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static long long timeval_us(const struct timeval *tv) {
+	return tv->tv_sec * 1000000LL + tv->tv_usec;
+}
+
+static void timeval_sub(struct timeval *out, const struct timeval *a,
+						const struct timeval *b) {
+	long long us = timeval_us(a) - timeval_us(b);
+	out->tv_sec = us / 1000000;
+	out->tv_usec = us % 1000000;
+}
+
+void timing_begin(struct timing_run *run) {
+	memset(run, 0, sizeof(*run));
+	getrusage(RUSAGE_SELF, &run->self_start);
+	run->start_ns = timing_now_ns();
+}
+
+void timing_add_stage(struct timing_run *run, const char *name,
+					  long long wall_ns, const struct rusage *usage,
+					  int status) {
+	run->stages = realloc(run->stages, sizeof(struct timing_stage) *
+										   (run->stage_count + 1));
+	struct timing_stage *stage = &run->stages[run->stage_count++];
+	snprintf(stage->name, sizeof(stage->name), "%s", name);
+	stage->wall_ns = wall_ns;
+	stage->usage = *usage;
+	stage->status = status;
+}
+
+void timing_end(struct timing_run *run, const char *name) {
+	run->wall_ns = timing_now_ns() - run->start_ns;
+	if (run->stage_count > 0)
+		return;
+
+	struct rusage now, delta;
+	getrusage(RUSAGE_SELF, &now);
+	delta = now; // ru_maxrss stays the peak of the shell itself
+	timeval_sub(&delta.ru_utime, &now.ru_utime, &run->self_start.ru_utime);
+	timeval_sub(&delta.ru_stime, &now.ru_stime, &run->self_start.ru_stime);
+	delta.ru_nvcsw = now.ru_nvcsw - run->self_start.ru_nvcsw;
+	delta.ru_nivcsw = now.ru_nivcsw - run->self_start.ru_nivcsw;
+	timing_add_stage(run, name, run->wall_ns, &delta, 0);
+}
+
+static void report_line(const char *label, long long wall_ns,
+						const struct rusage *ru) {
+	fprintf(stderr,
+			"[time] %-12s real %lld.%06llds  user %lld.%06llds  "
+			"sys %lld.%06llds  maxrss %ldKB  ctxsw %ldv/%ldi\n",
+			label, wall_ns / 1000000000LL, (wall_ns / 1000) % 1000000,
+			(long long)ru->ru_utime.tv_sec, (long long)ru->ru_utime.tv_usec,
+			(long long)ru->ru_stime.tv_sec, (long long)ru->ru_stime.tv_usec,
+			ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw);
+}
+
+void timing_report(const struct timing_run *run) {
+	struct rusage total;
+	memset(&total, 0, sizeof(total));
+	fflush(stdout); // keep the report after the command's own output
+
+	for (int i = 0; i < run->stage_count; i++) {
+		const struct rusage *ru = &run->stages[i].usage;
+		report_line(run->stages[i].name, run->stages[i].wall_ns, ru);
+
+		long long user = timeval_us(&total.ru_utime) + timeval_us(&ru->ru_utime);
+		long long sys = timeval_us(&total.ru_stime) + timeval_us(&ru->ru_stime);
+		total.ru_utime.tv_sec = user / 1000000;
+		total.ru_utime.tv_usec = user % 1000000;
+		total.ru_stime.tv_sec = sys / 1000000;
+		total.ru_stime.tv_usec = sys % 1000000;
+		if (ru->ru_maxrss > total.ru_maxrss)
+			total.ru_maxrss = ru->ru_maxrss;
+		total.ru_nvcsw += ru->ru_nvcsw;
+		total.ru_nivcsw += ru->ru_nivcsw;
+	}
+
+	if (run->stage_count > 1)
+		report_line("total", run->wall_ns, &total);
+}
+
+void timing_free(struct timing_run *run) {
+	free(run->stages);
+	run->stages = NULL;
+	run->stage_count = 0;
+}
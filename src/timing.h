@@ -0,0 +1,72 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <sys/resource.h>
+
+#define TIMING_NAME_MAX 64
+
+/*
+ * Resource accounting for one command line. External stages report the
+ * rusage wait4 returned for them; builtins are charged the shell's own
+ * getrusage delta.
+ */
+struct timing_stage {
+	char name[TIMING_NAME_MAX];
+	long long wall_ns;
+	struct rusage usage;
+	int status;
+};
+
+struct timing_run {
+	long long start_ns;
+	long long wall_ns;
+	struct rusage self_start;
+	struct timing_stage *stages;
+	int stage_count;
+};
+
+// report every command, not only the ones prefixed with time
+extern bool timing_always;
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+long long timing_now_ns(void);
+
+/**
+ * Start accounting for a command line
+ */
+void timing_begin(struct timing_run *run);
+
+/**
+ * Record a finished pipeline stage
+ * @param run     accounting started by timing_begin
+ * @param name    command name of the stage
+ * @param wall_ns time from fork to reap
+ * @param usage   rusage returned by wait4
+ * @param status  wait status
+ */
+void timing_add_stage(struct timing_run *run, const char *name,
+					  long long wall_ns, const struct rusage *usage,
+					  int status);
+
+/**
+ * Finish accounting; when no stage was recorded the command ran inside
+ * the shell and is charged the shell's own usage since timing_begin
+ * @param run  accounting started by timing_begin
+ * @param name command name to report for an in-shell command
+ */
+void timing_end(struct timing_run *run, const char *name);
+
+/**
+ * Print one line per stage (and a total for pipelines) to stderr
+ */
+void timing_report(const struct timing_run *run);
+
+/**
+ * Release the stages of a run
+ */
+void timing_free(struct timing_run *run);
+
+#endif
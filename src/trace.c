@@ -0,0 +1,237 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_RING_SIZE 16384 // power of two
+#define TRACE_NAME_MAX 24
+#define TRACE_LABEL_MAX 64
+#define DURATION_MAX 32 // "-9223372036854775808ns" and the nul fit
+
+/*
+ * A writer claims an index with one fetch_add, fills the slot and then
+ * publishes it by storing index + 1 into seq. Readers only trust slots
+ * whose seq matches, so a slot being overwritten is skipped, not torn.
+ */
+struct trace_slot {
+	_Atomic unsigned long long seq;
+	int kind;
+	int pid;
+	long long start_ns;
+	long long dur_ns;
+	char name[TRACE_NAME_MAX];
+};
+
+struct trace_ring {
+	_Atomic unsigned long long head;
+	_Atomic unsigned long long reset_at;
+	struct trace_slot slots[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *ring;
+
+static const char *kind_names[TRACE_KIND_COUNT] = {
+	"parse", "path", "fork", "redirect", "wait", "builtin",
+};
+
+int trace_init(void) {
+	void *mem = mmap(NULL, sizeof(struct trace_ring), PROT_READ | PROT_WRITE,
+					 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return -1;
+	ring = mem; // anonymous mappings start zeroed
+	return 0;
+}
+
+long long trace_begin(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void trace_end(enum trace_kind kind, const char *name, long long start) {
+	if (ring == NULL)
+		return;
+	long long end = trace_begin();
+
+	unsigned long long idx =
+		atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+	struct trace_slot *slot = &ring->slots[idx & (TRACE_RING_SIZE - 1)];
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	slot->kind = kind;
+	slot->pid = getpid();
+	slot->start_ns = start;
+	slot->dur_ns = end - start;
+	strncpy(slot->name, name ? name : kind_names[kind], TRACE_NAME_MAX - 1);
+	slot->name[TRACE_NAME_MAX - 1] = 0;
+	atomic_store_explicit(&slot->seq, idx + 1, memory_order_release);
+}
+
+void trace_reset(void) {
+	if (ring == NULL)
+		return;
+	atomic_store(&ring->reset_at, atomic_load(&ring->head));
+}
+
+/**
+ * Copy out every published span still in the ring
+ * @param  out receives a malloc'd array
+ * @return     number of spans
+ */
+static int trace_snapshot(struct trace_slot **out) {
+	*out = NULL;
+	if (ring == NULL)
+		return 0;
+
+	unsigned long long head = atomic_load(&ring->head);
+	unsigned long long from = atomic_load(&ring->reset_at);
+	if (head - from > TRACE_RING_SIZE)
+		from = head - TRACE_RING_SIZE;
+
+	struct trace_slot *spans = malloc(sizeof(struct trace_slot) *
+									  (head - from + 1));
+	int count = 0;
+	for (unsigned long long idx = from; idx < head; idx++) {
+		struct trace_slot *slot = &ring->slots[idx & (TRACE_RING_SIZE - 1)];
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != idx + 1)
+			continue;
+		memcpy(&spans[count], slot, sizeof(*slot));
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != idx + 1)
+			continue; // overwritten while copying
+		count++;
+	}
+	*out = spans;
+	return count;
+}
+
+struct label_stats {
+	char label[TRACE_NAME_MAX + 16];
+	long long *durations;
+	int count;
+};
+
+static int compare_ll(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+static void format_ns(char *out, size_t size, long long ns) {
+	if (ns < 10000LL)
+		snprintf(out, size, "%lldns", ns);
+	else if (ns < 10000000LL)
+		snprintf(out, size, "%.1fus", ns / 1e3);
+	else if (ns < 10000000000LL)
+		snprintf(out, size, "%.1fms", ns / 1e6);
+	else
+		snprintf(out, size, "%.2fs", ns / 1e9);
+}
+
+static void print_histogram(int out_fd, struct label_stats *st) {
+	int buckets[64] = { 0 };
+	int peak = 0;
+	for (int i = 0; i < st->count; i++) {
+		long long d = st->durations[i] > 0 ? st->durations[i] : 1;
+		int b = 63 - __builtin_clzll(d);
+		if (++buckets[b] > peak)
+			peak = buckets[b];
+	}
+	for (int b = 0; b < 64; b++) {
+		if (buckets[b] == 0)
+			continue;
+		char lo[DURATION_MAX], hi[DURATION_MAX];
+		format_ns(lo, sizeof(lo), 1LL << b);
+		format_ns(hi, sizeof(hi), b < 62 ? 1LL << (b + 1) : 0);
+		int bar = buckets[b] * 40 / peak;
+		dprintf(out_fd, "    %9s - %-9s %6d %.*s\n", lo, hi, buckets[b],
+				bar > 0 ? bar : 1,
+				"########################################");
+	}
+}
+
+void trace_print_stats(int out_fd, int histograms) {
+	struct trace_slot *spans;
+	int count = trace_snapshot(&spans);
+	struct label_stats labels[TRACE_LABEL_MAX];
+	int label_count = 0;
+
+	for (int i = 0; i < count; i++) {
+		char label[sizeof(labels[0].label)];
+		if (spans[i].kind == TRACE_BUILTIN)
+			snprintf(label, sizeof(label), "builtin:%s", spans[i].name);
+		else
+			snprintf(label, sizeof(label), "%s", spans[i].name);
+
+		int l = 0;
+		while (l < label_count && strcmp(labels[l].label, label) != 0)
+			l++;
+		if (l == label_count) {
+			if (label_count == TRACE_LABEL_MAX)
+				continue;
+			strcpy(labels[l].label, label);
+			labels[l].durations = malloc(sizeof(long long) * count);
+			labels[l].count = 0;
+			label_count++;
+		}
+		labels[l].durations[labels[l].count++] = spans[i].dur_ns;
+	}
+
+	dprintf(out_fd, "%-24s %8s %10s %10s %10s\n", "span", "count", "p50",
+			"p99", "max");
+	for (int l = 0; l < label_count; l++) {
+		struct label_stats *st = &labels[l];
+		char p50[DURATION_MAX], p99[DURATION_MAX], max[DURATION_MAX];
+		qsort(st->durations, st->count, sizeof(long long), compare_ll);
+		format_ns(p50, sizeof(p50), st->durations[(st->count - 1) * 50 / 100]);
+		format_ns(p99, sizeof(p99), st->durations[(st->count - 1) * 99 / 100]);
+		format_ns(max, sizeof(max), st->durations[st->count - 1]);
+		dprintf(out_fd, "%-24s %8d %10s %10s %10s\n", st->label, st->count,
+				p50, p99, max);
+		if (histograms)
+			print_histogram(out_fd, st);
+		free(st->durations);
+	}
+	free(spans);
+}
+
+static void json_string(FILE *out, const char *s) {
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+int trace_export_chrome(const char *path) {
+	FILE *out = fopen(path, "w");
+	if (out == NULL)
+		return -1;
+
+	struct trace_slot *spans;
+	int count = trace_snapshot(&spans);
+	fprintf(out, "{\"traceEvents\":[");
+	for (int i = 0; i < count; i++) {
+		fprintf(out, "%s\n{\"name\":", i ? "," : "");
+		json_string(out, spans[i].name);
+		fprintf(out,
+				",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":%d,\"tid\":%d}",
+				kind_names[spans[i].kind], spans[i].start_ns / 1e3,
+				spans[i].dur_ns / 1e3, spans[i].pid, spans[i].pid);
+	}
+	fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	free(spans);
+
+	if (fclose(out) != 0)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Self-instrumentation of the shell's hot paths. Spans are timed with the
+ * monotonic clock and appended to a lock-free ring buffer that lives in a
+ * shared mapping, so the children the shell forks can record the part of
+ * the launch they do themselves (PATH lookup, redirects) before exec.
+ */
+enum trace_kind {
+	TRACE_PARSE, // parse_command
+	TRACE_PATH, // PATH resolution in the child
+	TRACE_FORK, // fork() in the shell
+	TRACE_REDIRECT, // redirect setup in the child
+	TRACE_WAIT, // waiting for a foreground pipeline
+	TRACE_BUILTIN, // a command run inside the shell
+	TRACE_KIND_COUNT,
+};
+
+/**
+ * Map the ring buffer; spans recorded before this are dropped
+ * @return 0, -1 if the mapping failed (tracing stays off)
+ */
+int trace_init(void);
+
+/**
+ * Start a span
+ * @return start timestamp to hand to trace_end
+ */
+long long trace_begin(void);
+
+/**
+ * Finish a span and record it
+ * @param kind  what was measured
+ * @param name  label shown in reports, NULL for the kind's own name
+ * @param start value returned by trace_begin
+ */
+void trace_end(enum trace_kind kind, const char *name, long long start);
+
+/**
+ * Print count, p50, p99 and max for every label seen in the ring
+ * @param out_fd     fd to print to
+ * @param histograms also print a log2 histogram per label
+ */
+void trace_print_stats(int out_fd, int histograms);
+
+/**
+ * Export the ring as Chrome trace JSON (chrome://tracing, Perfetto)
+ * @param  path file to write
+ * @return      0, -1 with errno set on failure
+ */
+int trace_export_chrome(const char *path);
+
+/**
+ * Forget every recorded span
+ */
+void trace_reset(void);
+
+#endif
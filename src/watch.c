@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "dirscan.h"
+#include "shell.h"
+#include "watch.h"
+
+#define WATCH_MASK                                                         \
+	(IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVE |             \
+	 IN_DELETE_SELF | IN_ONLYDIR)
+#define EVENT_BUF_SIZE 65536
+
+// a watched directory, indexed by its watch descriptor
+struct watched {
+	char *path;
+	char *only; // the one entry that matters, NULL for all of them
+	bool used;
+};
+
+struct watch_set {
+	int fd; // inotify instance
+	struct watched *dirs;
+	int capacity;
+	int count; // live watches
+	bool full; // out of inotify watches, reported once
+};
+
+/**
+ * Watch one directory
+ * @param  only entry name to restrict events to, NULL for every entry
+ * @return      1 for a new watch or one that now covers the whole
+ *              directory, 0 if it was already watched, -1 on failure
+ */
+static int add_watch(struct watch_set *set, const char *path,
+					 const char *only) {
+	int wd = inotify_add_watch(set->fd, path, WATCH_MASK);
+	if (wd == -1 && errno != ENOSPC) {
+		fprintf(stderr, "-%s: watch-run: %s: %s\n", sysname, path,
+				strerror(errno));
+		return -1;
+	}
+	if (wd == -1) {
+		if (!set->full)
+			fprintf(stderr,
+					"-%s: watch-run: out of inotify watches, see "
+					"/proc/sys/fs/inotify/max_user_watches\n",
+					sysname);
+		set->full = true;
+		return -1;
+	}
+
+	if (wd >= set->capacity) {
+		int capacity = set->capacity ? set->capacity : 64;
+		while (capacity <= wd)
+			capacity *= 2;
+		set->dirs = realloc(set->dirs, sizeof(struct watched) * capacity);
+		memset(set->dirs + set->capacity, 0,
+			   sizeof(struct watched) * (capacity - set->capacity));
+		set->capacity = capacity;
+	}
+
+	struct watched *w = &set->dirs[wd];
+	if (w->used) {
+		// two files of one directory, or the directory itself after a
+		// file in it: watch everything there
+		if (w->only == NULL)
+			return 0;
+		bool widened = only == NULL;
+		if (only == NULL || strcmp(w->only, only) != 0) {
+			free(w->only);
+			w->only = NULL;
+		}
+		return widened; // not descended into yet
+	}
+	w->path = strdup(path);
+	w->only = only ? strdup(only) : NULL;
+	w->used = true;
+	set->count++;
+	return 1;
+}
+
+struct entries {
+	char **names;
+	unsigned char *types;
+	int count, capacity;
+};
+
+static int collect_entry(const char *name, unsigned char type, void *arg) {
+	struct entries *list = arg;
+	if (name[0] == '.')
+		return 0; // hidden, like cloc
+	if (type != DT_DIR && type != DT_UNKNOWN && type != DT_LNK)
+		return 0;
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->names = realloc(list->names, sizeof(char *) * list->capacity);
+		list->types = realloc(list->types, list->capacity);
+	}
+	list->names[list->count] = strdup(name);
+	list->types[list->count++] = type;
+	return 0;
+}
+
+/**
+ * Watch a directory and every directory below it. A directory reached
+ * twice through symlinks has the same watch and is not descended again.
+ */
+static void add_tree(struct watch_set *set, const char *path) {
+	if (add_watch(set, path, NULL) != 1)
+		return;
+
+	struct entries list = { 0 };
+	dirscan(AT_FDCWD, path, collect_entry, &list);
+	for (int i = 0; i < list.count; i++) {
+		char child[PATH_MAX];
+		int len = snprintf(child, sizeof(child), "%s/%s", path,
+						   list.names[i]);
+		if (len < (int)sizeof(child) &&
+			dirscan_is_dir(AT_FDCWD, child, list.types[i]))
+			add_tree(set, child);
+		free(list.names[i]);
+	}
+	free(list.names);
+	free(list.types);
+}
+
+/**
+ * Watch a file through its directory, so that it is still seen after an
+ * editor replaced it with a rename or when it does not exist yet
+ */
+static void add_file(struct watch_set *set, const char *path) {
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) {
+		add_watch(set, ".", path);
+		return;
+	}
+	char dir[PATH_MAX];
+	int len = slash == path ? 1 : (int)(slash - path);
+	snprintf(dir, sizeof(dir), "%.*s", len, path);
+	add_watch(set, dir, slash + 1);
+}
+
+/**
+ * Read every queued event, following new directories
+ * @return whether any of them was a change that matters
+ */
+static bool read_changes(struct watch_set *set) {
+	char buf[EVENT_BUF_SIZE]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+
+	for (;;) {
+		ssize_t n = read(set->fd, buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+
+		for (char *p = buf; p < buf + n;) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + ev->len;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				changed = true; // lost events, anything may have changed
+				continue;
+			}
+			if (ev->wd < 0 || ev->wd >= set->capacity ||
+				!set->dirs[ev->wd].used)
+				continue;
+
+			struct watched *w = &set->dirs[ev->wd];
+			if (ev->mask & IN_IGNORED) {
+				free(w->path);
+				free(w->only);
+				memset(w, 0, sizeof(*w));
+				set->count--;
+				changed = true;
+				continue;
+			}
+			if (ev->len > 0 && ev->name[0] == '.')
+				continue;
+			if (w->only != NULL &&
+				(ev->len == 0 || strcmp(ev->name, w->only) != 0))
+				continue;
+			changed = true;
+
+			if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) &&
+				(ev->mask & IN_ISDIR) && w->only == NULL) {
+				char child[PATH_MAX];
+				int len = snprintf(child, sizeof(child), "%s/%s", w->path,
+								   ev->name);
+				if (len < (int)sizeof(child))
+					add_tree(set, child); // may move set->dirs
+			}
+		}
+	}
+	return changed;
+}
+
+static void run_line(const char *line) {
+	char *buf = strdup(line);
+	struct command_t *command = calloc(1, sizeof(struct command_t));
+	parse_command(buf, command);
+	process_command(command);
+	free_command(command);
+	free(buf);
+	fflush(stdout);
+}
+
+/**
+ * Body of the watcher child
+ * @return exit status once nothing is left to watch
+ */
+static int watch_loop(char **paths, const char *line, int quiet_ms) {
+	struct watch_set set = { 0 };
+	set.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (set.fd == -1) {
+		fprintf(stderr, "-%s: watch-run: %s\n", sysname, strerror(errno));
+		return 1;
+	}
+	for (int i = 0; paths[i] != NULL; i++) {
+		struct stat st;
+		if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode))
+			add_tree(&set, paths[i]);
+		else
+			add_file(&set, paths[i]);
+	}
+
+	bool rerun = false; // the last run was for changes during the one before
+	while (set.count > 0) {
+		run_line(line);
+		// changes during a run may be edits, or the command's own writes:
+		// they get one more run, and what changes during that one is taken
+		// for the command's own
+		bool changed = read_changes(&set) && !rerun;
+		rerun = changed;
+
+		// block until the first change, then wait for quiet_ms without one
+		while (set.count > 0) {
+			struct pollfd pfd = { set.fd, POLLIN, 0 };
+			int ready = poll(&pfd, 1, changed ? quiet_ms : -1);
+			if (ready == -1 && errno == EINTR)
+				continue;
+			if (ready == -1) {
+				fprintf(stderr, "-%s: watch-run: %s\n", sysname,
+						strerror(errno));
+				return 1;
+			}
+			if (ready == 0)
+				break;
+			if (read_changes(&set))
+				changed = true;
+		}
+	}
+	fprintf(stderr, "-%s: watch-run: nothing left to watch\n", sysname);
+	return 1;
+}
+
+int watch_run(char **paths, const char *line, int quiet_ms, int in_fd,
+			  int out_fd) {
+	// Ctrl-C is for the watcher and its command, the shell carries on
+	struct sigaction ignore = { .sa_handler = SIG_IGN }, old_int, old_quit;
+	sigaction(SIGINT, &ignore, &old_int);
+	sigaction(SIGQUIT, &ignore, &old_quit);
+
+	fflush(stdout); // don't let the child inherit pending output
+	pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		signal(SIGPIPE, SIG_DFL); // ignored by the shell itself
+		if (in_fd != STDIN_FILENO)
+			dup2(in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO)
+			dup2(out_fd, STDOUT_FILENO);
+		_exit(watch_loop(paths, line, quiet_ms));
+	}
+
+	int status = 0;
+	if (pid != -1) {
+		while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+	}
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGQUIT, &old_quit, NULL);
+
+	if (pid == -1) {
+		fprintf(stderr, "-%s: fork: %s\n", sysname, strerror(errno));
+		return 1;
+	}
+	if (WIFSIGNALED(status))
+		return WTERMSIG(status) == SIGINT ? 0 : 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
@@ -0,0 +1,24 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/**
+ * Run a command line, then again whenever something below paths changed,
+ * until interrupted with Ctrl-C. Directories are watched recursively with
+ * inotify, skipping hidden entries like cloc does; a burst of events runs
+ * the command once, after quiet_ms without further events. Changes made
+ * while the command runs can't be told apart from its own writes: they
+ * run it once more, and changes made during that run are ignored, so a
+ * command writing below paths doesn't run forever and an edit saved during
+ * a long run isn't lost. The watcher is a child of the shell, so Ctrl-C
+ * stops it and leaves the shell running.
+ * @param  paths    NULL terminated files and directories to watch
+ * @param  line     command line to run
+ * @param  quiet_ms how long events have to stop before the command runs
+ * @param  in_fd    stdin for the command
+ * @param  out_fd   stdout for the command
+ * @return          exit status, 0 after Ctrl-C
+ */
+int watch_run(char **paths, const char *line, int quiet_ms, int in_fd,
+			  int out_fd);
+
+#endif
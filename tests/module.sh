@@ -0,0 +1,74 @@
+#!/bin/sh
+# Build the pstree module against the running kernel, or KDIR, and load it
+# with each query option. Skipped without a kernel build tree, loading is
+# skipped without root.
+# usage: tests/module.sh [path to mishell]
+
+kdir=${KDIR:-/lib/modules/$(uname -r)/build}
+if [ ! -d "$kdir" ]; then
+	echo "module: skipped, no kernel build tree at $kdir"
+	exit 0
+fi
+if ! make -C module KDIR="$kdir" >/dev/null; then
+	echo 'FAIL module build'
+	exit 1
+fi
+if [ "$(id -u)" != 0 ]; then
+	echo 'module: built, loading skipped without root'
+	exit 0
+fi
+failed=0
+
+# load <name> <insmod should succeed: 0/1> <options>...
+# leaves the lines the module logged in $log
+load() {
+	name=$1
+	want=$2
+	shift 2
+	before=$(dmesg | wc -l)
+	if insmod module/mymodule.ko pid=1 "$@" 2>/dev/null; then
+		rmmod mymodule
+		got=0
+	else
+		got=1
+	fi
+	log=$(dmesg -t | tail -n +$((before + 1)))
+	if [ "$got" != "$want" ]; then
+		printf 'FAIL %s: insmod %s exited %s\n' "$name" "$*" "$got"
+		failed=1
+	fi
+}
+
+# expect <name> <pattern>: a logged line matches
+expect() {
+	if ! printf '%s\n' "$log" | grep -q -- "$2"; then
+		printf 'FAIL %s: no line matching %s\n' "$1" "$2"
+		failed=1
+	fi
+}
+
+edge='^"PID:[0-9]*, Creation Time:[0-9]*" ->"PID:'
+
+load plain 0
+expect plain "$edge"
+load threads 0 threads=1
+expect threads "$edge"
+load pidns 0 pidns=$$
+expect pidns "$edge"
+load cgroup 0 cgroup=/
+expect cgroup "$edge"
+load max_depth 0 max_depth=1
+if printf '%s\n' "$log" | grep -- "$edge" | grep -qv '^"PID:1,'; then
+	echo 'FAIL max_depth: an edge below the first level'
+	failed=1
+fi
+load min_size 0 min_size=1000000000
+if printf '%s\n' "$log" | grep -q -- "$edge"; then
+	echo 'FAIL min_size: an edge of a subtree that is too small'
+	failed=1
+fi
+load no-such-pid 1 pid=999999999
+load no-such-cgroup 1 cgroup=/no/such/cgroup
+
+[ "$failed" = 0 ] && echo 'module: ok'
+exit "$failed"
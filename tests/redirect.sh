@@ -0,0 +1,49 @@
+#!/bin/sh
+# Redirections of a builtin running inside the shell are undone afterwards,
+# including those of fds above stderr.
+# usage: tests/redirect.sh [path to mishell]
+
+shell=$(realpath "${1:-./mishell}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+failed=0
+
+# check <name> <expected output> <lines>
+check() {
+	got=$(printf '%s\n' "$3" | MISHELL_PS1='' timeout 10 "$shell" 2>&1 |
+		grep -vxF -e "$(printf '%s\n' "$3")")
+	if [ "$got" != "$2" ]; then
+		printf 'FAIL %s\n  lines:    %s\n  expected: %s\n  got:      %s\n' \
+			"$1" "$3" "$2" "$got"
+		failed=1
+	fi
+}
+
+# the shell still reads its commands from stdin, and ls only has the fd of
+# the directory it lists besides 0-2
+fds='0
+1
+2
+3'
+check timing-3 "timing is off
+after" "timing 3>x
+echo after"
+check cd-3 "after" "cd . 3>x
+echo after"
+# the shell's own copies of 0-2 used to land here
+check timing-4 "timing is off
+after" "timing 4>x
+echo after"
+check cd-4 "after" "cd . 4>x
+echo after"
+check timing-7 "timing is off
+$fds" "timing 7>y
+ls /proc/self/fd"
+check cd-7 "$fds" "cd . 7>y
+ls /proc/self/fd"
+check stdout "after" "cd . >z
+echo after"
+
+[ "$failed" = 0 ] && echo 'redirect: ok'
+exit "$failed"
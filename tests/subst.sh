@@ -0,0 +1,40 @@
+#!/bin/sh
+# Output of $(...) is only words: operator characters in it must not turn
+# into redirects, pipes or background jobs.
+# usage: tests/subst.sh [path to mishell]
+
+shell=$(realpath "${1:-./mishell}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+failed=0
+
+# check <name> <expected output> <line>
+check() {
+	got=$(printf '%s\n' "$3" | MISHELL_PS1='' timeout 10 "$shell" 2>&1 |
+		grep -vxF -e "$3")
+	if [ "$got" != "$2" ]; then
+		printf 'FAIL %s\n  line:     %s\n  expected: %s\n  got:      %s\n' \
+			"$1" "$3" "$2" "$got"
+		failed=1
+	fi
+}
+
+check redirect-out '>pwned' "echo \$(echo '>pwned')"
+check redirect-in '<input' "echo \$(echo '<input')"
+check append 'a >>b' "echo \$(echo 'a' '>>b')"
+check fd-dup '2>&1' "echo \$(echo '2>&1')"
+check here-string '<<< x' "echo \$(echo '<<<' x)"
+check pipe 'a | b' "echo \$(echo a '|' b)"
+check background 'a &' "echo \$(echo a '&')"
+check quotes "'q' \"r\"" "echo \$(echo \"'q'\" '\"r\"')"
+check quoted-word 'x>y' "echo \"x\$(echo '>y')\""
+check long-word 3001 "echo \$(printf %03000d 0) | wc -c"
+check long-glob 3002 "echo \$(printf %03000d 0)* | wc -c"
+
+if [ -n "$(ls -A)" ]; then
+	printf 'FAIL files created: %s\n' "$(ls -A | tr '\n' ' ')"
+	failed=1
+fi
+[ "$failed" = 0 ] && echo 'subst: ok'
+exit "$failed"